@@ -0,0 +1,92 @@
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+int main() {
+  std::array<uint64_t const, 2> const row_shape{3, 2};
+
+  // append rows one at a time, with a buffer small enough to force writes
+  {
+    cnpypp::NpyAppender<int32_t> appender{"appended.npy", row_shape, "w",
+                                          cnpypp::MemoryOrder::C, 64};
+
+    for (int32_t i = 0; i < 1000; ++i) {
+      std::array<int32_t, 6> row;
+      std::iota(row.begin(), row.end(), 6 * i);
+      appender.append(row.cbegin(), 1);
+    }
+
+    appender.flush();
+
+    // non-contiguous input
+    std::list<int32_t> const rows(6 * 2, -1);
+    appender.append(rows.cbegin(), 2);
+
+    if (appender.rows() != 1002) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // reopen and append more, growing the header across a digit boundary
+  {
+    cnpypp::NpyAppender<int32_t> appender{"appended.npy", row_shape, "a"};
+    std::vector<int32_t> const rows(6 * 99000, 7);
+    appender.append(rows.cbegin(), 99000);
+  }
+
+  {
+    cnpypp::NpyArray const arr = cnpypp::npy_load("appended.npy");
+    auto const* const data = arr.data<int32_t>();
+
+    if (arr.shape != std::vector<uint64_t>{100002, 3, 2}) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    for (int32_t i = 0; i < 6000; ++i) {
+      if (data[i] != i) {
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (data[6000] != -1 || data[6 * 1002] != 7 ||
+        data[arr.num_vals - 1] != 7) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // structured rows
+  {
+    using tuple_t = std::tuple<double, int8_t, uint16_t>;
+    std::vector<tuple_t> const tuples{{1.5, 2, 3}, {4.5, 5, 6}, {7.5, 8, 9}};
+
+    {
+      cnpypp::NpyTupleAppender<tuple_t> appender{"appended_struct.npy",
+                                                 {"a", "b", "c"}};
+      appender.append(tuples.cbegin(), tuples.size());
+      appender.append(tuples.cbegin(), 1);
+    }
+
+    cnpypp::NpyArray arr = cnpypp::npy_load("appended_struct.npy");
+    auto r = arr.tuple_range<double, int8_t, uint16_t>();
+
+    if (arr.shape != std::vector<uint64_t>{4} ||
+        !std::equal(tuples.cbegin(), tuples.cend(), r.begin()) ||
+        *std::next(r.begin(), 3) != tuples.front()) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// compares summing up a field of a structured array with column_range(), the
+// column_sum() kernel and converting it with to_columns() and summing up the
+// contiguous column. to_columns() is compared to copying the array into a new
+// buffer, the kernels on the contiguous column to the standard algorithms
+
+static size_t constexpr num_records = 1 << 24;
+
+int main() {
+  std::vector<std::tuple<int32_t, int8_t, int16_t>> records(num_records);
+  for (size_t i = 0; i < num_records; ++i) {
+    records[i] = {static_cast<int32_t>(i), static_cast<int8_t>(i),
+                  static_cast<int16_t>(i)};
+  }
+  std::array<uint64_t const, 1> const shape{num_records};
+  cnpypp::npy_save("columns_speedtest.npy", {"a", "b", "c"}, records.cbegin(),
+                   shape);
+  cnpypp::NpyArray const arr = cnpypp::npy_load("columns_speedtest.npy");
+
+  int64_t sum_iterator = 0, sum_columns = 0;
+  double const t_iterator = measure([&]() {
+    for (auto const x : arr.column_range<int32_t>("a")) {
+      sum_iterator += x;
+    }
+  });
+
+  std::vector<cnpypp::NpyArray> columns;
+  double const t_to_columns = measure([&]() { columns = arr.to_columns(); });
+
+  // same amount of data, including the page faults of the new buffer
+  double const t_copy = measure([&]() {
+    cnpypp::InMemoryBuffer copy{arr.num_bytes(), 64};
+    std::memcpy(copy.data(), arr.data<std::byte>(), arr.num_bytes());
+  });
+
+  double const t_sum = measure([&]() {
+    int32_t const* const a = columns.at(0).data<int32_t>();
+    for (size_t i = 0; i < num_records; ++i) {
+      sum_columns += a[i];
+    }
+  });
+
+  std::array<std::string_view const, 3> const labels{"a", "b", "c"};
+  bool equal = false;
+  double const t_from_columns = measure(
+      [&]() { equal = cnpypp::from_columns(columns, labels) == arr; });
+
+  if (sum_iterator != sum_columns || !equal) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // column kernels directly on the interleaved records
+  int64_t sum_kernel = 0, sum_kernel_mt = 0;
+  double const t_kernel = measure(
+      [&]() { sum_kernel = cnpypp::column_sum(arr.column<int32_t>("a")); });
+  double const t_kernel_mt = measure([&]() {
+    sum_kernel_mt = cnpypp::column_sum(arr.column<int32_t>("a"), 0);
+  });
+
+  if (sum_kernel != sum_iterator || sum_kernel_mt != sum_iterator) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // kernels on the contiguous column. its values increase, so that every
+  // block holds a new maximum, but never a new minimum
+  int32_t const* const a = columns.at(0).data<int32_t>();
+  cnpypp::column_view<int32_t> const col{columns.at(0).data<std::byte>(),
+                                         sizeof(int32_t), num_records};
+  uint64_t argmin = 0, argmax = 0, min_element = 0, max_element = 0;
+  double const t_argmin =
+      measure([&]() { argmin = cnpypp::column_argmin(col); });
+  double const t_argmax =
+      measure([&]() { argmax = cnpypp::column_argmax(col); });
+  double const t_min_element = measure(
+      [&]() { min_element = std::min_element(a, a + num_records) - a; });
+  double const t_max_element = measure(
+      [&]() { max_element = std::max_element(a, a + num_records) - a; });
+
+  if (argmin != min_element || argmax != max_element) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "column_range sum:   " << t_iterator << " s" << std::endl;
+  std::cout << "column_sum:         " << t_kernel << " s" << std::endl;
+  std::cout << "column_sum (all threads): " << t_kernel_mt << " s" << std::endl;
+  std::cout << "to_columns:         " << t_to_columns << " s" << std::endl;
+  std::cout << "copy to new buffer: " << t_copy << " s" << std::endl;
+  std::cout << "contiguous sum:     " << t_sum << " s" << std::endl;
+  std::cout << "from_columns:       " << t_from_columns << " s" << std::endl;
+  std::cout << "column_argmin:      " << t_argmin << " s" << std::endl;
+  std::cout << "std::min_element:   " << t_min_element << " s" << std::endl;
+  std::cout << "column_argmax:      " << t_argmax << " s" << std::endl;
+  std::cout << "std::max_element:   " << t_max_element << " s" << std::endl;
+
+  return EXIT_SUCCESS;
+}
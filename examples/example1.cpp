@@ -92,6 +92,169 @@ int main() {
     }
   }
 
+  // data aligned to a page boundary in the file are mapped to a page boundary
+  {
+    cnpypp::npy_save("arr1-aligned.npy", data.cbegin(), shape, "w",
+                     cnpypp::MemoryOrder::C, 0, 4096);
+
+    for (bool const memory_mapped : {false, true}) {
+      cnpypp::NpyArray const arr =
+          cnpypp::npy_load("arr1-aligned.npy", memory_mapped);
+
+      if (reinterpret_cast<uintptr_t>(arr.data<void>()) % 4096 != 0) {
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if (!std::equal(data.cbegin(), data.cend(), arr.data<uint32_t>())) {
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // load into memory provided by the caller
+  {
+    std::vector<uint32_t> dest(data.size());
+    cnpypp::span<std::byte> const dest_bytes{
+        reinterpret_cast<std::byte*>(dest.data()),
+        dest.size() * sizeof(uint32_t)};
+    cnpypp::NpyArray const arr =
+        cnpypp::npy_load_into("arr1-cpy.npy", dest_bytes);
+
+    if (arr.data<uint32_t>() != dest.data() || arr.shape != shape ||
+        !std::equal(data.cbegin(), data.cend(), dest.cbegin())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // destination too small
+    try {
+      cnpypp::npy_load_into("arr1-cpy.npy",
+                            dest_bytes.first(dest_bytes.size() - 1));
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    } catch (std::runtime_error const&) {
+    }
+  }
+
+  // parallel read in small chunks
+  if (cnpypp::npy_load_parallel("arr1-cpy.npy", 3, 100) !=
+      cnpypp::npy_load("arr1-cpy.npy")) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // read only some rows
+  {
+    uint64_t const first = 3, count = 4;
+    uint64_t const row_size = Ny * Nx;
+    std::vector<uint64_t> const rows_shape{count, Ny, Nx};
+
+    cnpypp::NpyArray const arr =
+        cnpypp::npy_load_rows("arr1-cpy.npy", first, count);
+    cnpypp::NpyArray const arr_mapped =
+        cnpypp::npy_load_rows_mapped("arr1-cpy.npy", first, count);
+
+    if (arr.shape != rows_shape || !(arr == arr_mapped) ||
+        !std::equal(std::next(data.cbegin(), first * row_size),
+                    std::next(data.cbegin(), (first + count) * row_size),
+                    arr.data<uint32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    try {
+      cnpypp::npy_load_rows("arr1-cpy.npy", Nz - 1, 2);
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    } catch (std::runtime_error const&) {
+    }
+  }
+
+  // read a strided tile
+  {
+    std::array<cnpypp::AxisSelection const, 3> const selection{
+        {{1, 3, 3}, {1, 2, 1}, {0, Nx, 1}}};
+    cnpypp::NpyArray const arr =
+        cnpypp::npy_load_hyperslab("arr1-cpy.npy", selection, 2);
+
+    std::vector<uint32_t> expected;
+    for (uint64_t z = 1; z < Nz; z += 3) {
+      for (uint64_t y = 1; y < 3; ++y) {
+        for (uint64_t x = 0; x < Nx; ++x) {
+          expected.push_back(data[(z * Ny + y) * Nx + x]);
+        }
+      }
+    }
+
+    if (arr.shape != std::vector<uint64_t>{3, 2, Nx} ||
+        !std::equal(expected.cbegin(), expected.cend(),
+                    arr.data<uint32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // shared read-only mapping with hints
+  {
+    cnpypp::MappingOptions options;
+    options.read_only = true;
+    options.advice = cnpypp::MappingOptions::Advice::Sequential;
+    options.huge_pages = true;
+    options.populate = true;
+
+    cnpypp::NpyArray const arr =
+        cnpypp::npy_load_mapped("arr1-cpy.npy", options);
+
+    if (arr.shape != shape ||
+        !std::equal(data.cbegin(), data.cend(), arr.data<uint32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // reading through a non-const array works as well
+    cnpypp::NpyArray arr2 = cnpypp::npy_load_mapped("arr1-cpy.npy", options);
+    if (!std::equal(data.cbegin(), data.cend(), arr2.data<uint32_t>()) ||
+        !std::equal(data.cbegin(), data.cend(), arr2.begin<uint32_t>(),
+                    arr2.end<uint32_t>()) ||
+        !std::equal(data.cbegin(), data.cend(),
+                    arr2.make_range<uint32_t>().begin())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // fill a file through a writable mapping and modify it in place
+  {
+    {
+      cnpypp::NpyArray arr =
+          cnpypp::npy_create_mapped<uint32_t>("arr1-mapped.npy", shape);
+      std::copy(data.cbegin(), data.cend(), arr.data<uint32_t>());
+      arr.flush();
+    }
+
+    if (cnpypp::npy_load("arr1-mapped.npy") !=
+        cnpypp::npy_load("arr1-cpy.npy")) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    {
+      cnpypp::NpyArray arr = cnpypp::npy_open_mapped_rw("arr1-mapped.npy");
+      arr.data<uint32_t>()[1] = 42;
+      arr.flush(sizeof(uint32_t), sizeof(uint32_t));
+    }
+
+    cnpypp::NpyArray const arr = cnpypp::npy_load("arr1-mapped.npy");
+    if (arr.data<uint32_t>()[0] != data[0] || arr.data<uint32_t>()[1] != 42 ||
+        !std::equal(std::next(data.cbegin(), 2), data.cend(),
+                    arr.data<uint32_t>() + 2)) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
   // tuples written to NPY with structured data type
   {
     std::vector<std::tuple<int32_t, int8_t, int16_t>> const tupleVec{
@@ -110,6 +273,107 @@ int main() {
       std::cerr << "error in line " << __LINE__ << std::endl;
       return EXIT_FAILURE;
     }
+
+    // non-const ranges over a read-only mapping
+    {
+      cnpypp::MappingOptions options;
+      options.read_only = true;
+      cnpypp::NpyArray ro = cnpypp::npy_load_mapped("structured.npy", options);
+      auto const rt = ro.tuple_range<int32_t, int8_t, int16_t>();
+      auto const rc = ro.column_range<int16_t>("c");
+
+      if (!std::equal(tupleVec.begin(), tupleVec.end(), rt.begin()) ||
+          !std::equal(tupleVec.begin(), tupleVec.end(), rc.begin(),
+                      [](auto const& t, int16_t c) {
+                        return std::get<2>(t) == c;
+                      })) {
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // load only some of the fields
+    std::array<std::string_view const, 2> const fields{"c", "a"};
+    cnpypp::NpyArray const projected =
+        cnpypp::npy_load_columns("structured.npy", fields);
+    auto const rp = projected.tuple_range<int16_t, int32_t>();
+
+    if (projected.labels != std::vector<std::string>{"c", "a"} ||
+        !std::equal(tupleVec.begin(), tupleVec.end(), rp.begin(),
+                    [](auto const& a, auto const& b) {
+                      return std::get<2>(a) == std::get<0>(b) &&
+                             std::get<0>(a) == std::get<1>(b);
+                    })) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    auto const columns =
+        cnpypp::npy_load_column_arrays("structured.npy", fields);
+    auto const c = columns.at(0).data<int16_t>();
+    auto const a = columns.at(1).data<int32_t>();
+    for (size_t i = 0; i < tupleVec.size(); ++i) {
+      if (std::get<2>(tupleVec[i]) != c[i] ||
+          std::get<0>(tupleVec[i]) != a[i]) {
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (!columns[0].labels.empty() ||
+        cnpypp::npy_load_columns("structured.npy", {}).num_bytes() != 0) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // de-interleave all fields and back
+    std::array<std::string_view const, 3> const labels{"a", "b", "c"};
+    auto const all_columns = arr.to_columns();
+    if (all_columns.size() != 3 ||
+        !std::equal(columns[1].data<int32_t>(),
+                    columns[1].data<int32_t>() + tupleVec.size(),
+                    all_columns[0].data<int32_t>()) ||
+        !(cnpypp::from_columns(all_columns, labels) == arr)) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // column kernels
+    auto const col_c = arr.column<int16_t>("c");
+    std::vector<int64_t> prefix_sums(col_c.count);
+    cnpypp::column_prefix_sum(col_c, prefix_sums.data());
+    if (cnpypp::column_sum(col_c) != int16_t(0xcccc) + int16_t(0xffff) +
+                                         int16_t(0x7777) ||
+        cnpypp::column_argmin(arr.column<int32_t>("a")) != 2 ||
+        cnpypp::column_max(arr.column<int8_t>("b")) != int8_t(0xee) ||
+        cnpypp::column_count_if(col_c, [](int16_t x) { return x < 0; }) != 2 ||
+        prefix_sums.back() != cnpypp::column_sum(col_c)) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // append to structured NPY, reserving header space so that appending
+  // never needs to move the data
+  {
+    std::vector<std::tuple<int32_t, int8_t, int16_t>> const tupleVec{
+        {0x11111111, 0x22, 0x3333}, {0x44444444, 0x55, 0x6666}};
+
+    cnpypp::npy_save("structured_app.npy", {"a", "b", "c"}, tupleVec.begin(),
+                     {tupleVec.size()}, "w", cnpypp::MemoryOrder::C, 128);
+    cnpypp::npy_save("structured_app.npy", {"a", "b", "c"}, tupleVec.begin(),
+                     {tupleVec.size()}, "a");
+
+    cnpypp::NpyArray arr = cnpypp::npy_load("structured_app.npy");
+    auto r = arr.tuple_range<int32_t, int8_t, int16_t>();
+
+    if (arr.shape.size() != 1 || arr.shape.at(0) != 2 * tupleVec.size() ||
+        !std::equal(tupleVec.begin(), tupleVec.end(), r.begin()) ||
+        !std::equal(tupleVec.begin(), tupleVec.end(),
+                    std::next(r.begin(), tupleVec.size()))) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
   }
 
   // std::array written as structured type
@@ -156,5 +420,33 @@ int main() {
       return EXIT_FAILURE;
     }
   }
+
+  // pipelined writing from non-contiguous iterators, with small chunks
+  {
+    std::list<double> const list(1000, 0.5);
+    std::vector<std::pair<int8_t, uint16_t>> const pairs{
+        {0x11, 0x22}, {0x33, 0x44}, {0x55, 0x66}};
+    cnpypp::PipelineOptions const pipeline{7, 3};
+
+    cnpypp::npy_save("pipelined.npy", list.cbegin(), {list.size()}, "w",
+                     cnpypp::MemoryOrder::C, 0, 16, pipeline);
+    cnpypp::npy_save("pipelined_structured.npy", {"a", "b"}, pairs.cbegin(),
+                     {pairs.size()}, "w", cnpypp::MemoryOrder::C, 0, 16,
+                     pipeline);
+
+    cnpypp::NpyArray const arr = cnpypp::npy_load("pipelined.npy");
+    cnpypp::NpyArray const arr2 = cnpypp::npy_load("pipelined_structured.npy");
+    auto const r = arr2.tuple_range<int8_t, uint16_t>();
+    if (arr.num_vals != list.size() ||
+        !std::equal(list.cbegin(), list.cend(), arr.data<double>()) ||
+        !std::equal(pairs.cbegin(), pairs.cend(), r.begin(),
+                    [](auto const& a, auto const& b) {
+                      return a.first == std::get<0>(b) &&
+                             a.second == std::get<1>(b);
+                    })) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
   return EXIT_SUCCESS;
 }
@@ -1,11 +1,26 @@
+#include <array>
 #include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <list>
+#include <numeric>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
+#include <boost/iterator/counting_iterator.hpp>
+#include <boost/iterator/transform_iterator.hpp>
+
 #include <cnpy++.hpp>
 
+static std::vector<char> read_file(std::string const& fname) {
+  std::ifstream fs{fname, std::ios::binary};
+  return {std::istreambuf_iterator<char>{fs}, std::istreambuf_iterator<char>{}};
+}
+
 int main() {
   std::string_view const str1 = "abcdefghijklmno";
   std::string_view const str2 = "pqrstuvwxyz";
@@ -60,6 +75,21 @@ int main() {
     }
   }
 
+  // load into memory provided by the caller
+  {
+    std::vector<char> dest(str2.size());
+    cnpypp::NpyArray arr = cnpypp::npz_load_into(
+        "out.npz", "str2",
+        cnpypp::span<std::byte>{reinterpret_cast<std::byte*>(dest.data()),
+                                dest.size()});
+
+    if (arr.data<char>() != dest.data() ||
+        !std::equal(str2.cbegin(), str2.cend(), dest.cbegin())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
   std::list<uint32_t> const list_u{str1.cbegin(), str1.cend()}; // copy to list
   std::list<float> const list_f{str2.cbegin(), str2.cend()};
 
@@ -125,4 +155,219 @@ int main() {
       }
     }
   }
+
+  // load the entire npz file concurrently
+  {
+    cnpypp::npz_t const my_npz = cnpypp::npz_load("out.npz");
+    cnpypp::npz_t const my_npz_par = cnpypp::npz_load_parallel("out.npz", 2);
+
+    if (my_npz.size() != my_npz_par.size()) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    for (auto const& [name, arr] : my_npz) {
+      if (!(arr == my_npz_par.at(name))) {
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // access single arrays of the npz file on demand
+  {
+    cnpypp::NpzReader reader{"out.npz"};
+
+    if (reader.names() !=
+            std::vector<std::string>{"str", "str2", "arr1", "arr2"} ||
+        !reader.contains("arr1") || reader.contains("arr3")) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    cnpypp::NpyHeader const& header = reader.header("arr2");
+    if (header.shape != shape_f || header.word_sizes.at(0) != sizeof(float) ||
+        header.data_types.at(0) != 'f' || reader.is_cached("arr2")) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    cnpypp::NpyArray const& arr = reader.get("arr1");
+    if (&arr != &reader.get("arr1") || !reader.is_cached("arr1") ||
+        !std::equal(list_u.cbegin(), list_u.cend(), arr.data<uint32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    reader.evict("arr1");
+    cnpypp::NpyArray const arr2 = reader.load("arr2");
+    if (reader.is_cached("arr1") || reader.is_cached("arr2") ||
+        !std::equal(list_f.cbegin(), list_f.cend(), arr2.data<float>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    try {
+      reader.get("arr3");
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    } catch (std::runtime_error const&) {
+    }
+  }
+
+  // map stored arrays directly from the archive
+  {
+    cnpypp::npz_save("out.npz", "arr_stored", list_u.cbegin(), shape_u, "a",
+                     cnpypp::MemoryOrder::C, cnpypp::CompressionMethod::Store);
+
+    cnpypp::MappingOptions options;
+    options.read_only = true;
+    cnpypp::NpyArray const arr =
+        cnpypp::npz_load_mapped("out.npz", "arr_stored", options);
+    if (arr.shape != shape_u ||
+        !std::equal(list_u.cbegin(), list_u.cend(), arr.data<uint32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // compressed arrays are decompressed as usual
+    cnpypp::NpzReader reader{"out.npz"};
+    cnpypp::NpyArray const arr2 = reader.map("arr2");
+    if (!(reader.map("arr_stored") == arr) ||
+        !std::equal(list_f.cbegin(), list_f.cend(), arr2.data<float>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // deflate a larger array concurrently
+  {
+    std::vector<uint32_t> large(1 << 20);
+    std::iota(large.begin(), large.end(), 0u);
+    std::array<uint64_t const, 1> const shape_large{large.size()};
+    cnpypp::npz_save("out.npz", "arr_large", large.cbegin(), shape_large, "a",
+                     cnpypp::MemoryOrder::C, cnpypp::CompressionMethod::Deflate,
+                     4);
+
+    cnpypp::NpyArray const arr = cnpypp::npz_load("out.npz", "arr_large");
+    if (arr.shape.at(0) != large.size() ||
+        !std::equal(large.cbegin(), large.cend(), arr.data<uint32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // write several arrays in one session
+  {
+    std::vector<std::tuple<int32_t, double>> const tuples{{1, 1.5}, {2, 2.5}};
+    std::array<uint64_t const, 1> const shape_t{tuples.size()};
+    {
+      cnpypp::NpzWriter writer{"session.npz"};
+      writer.add("arr_u", list_u.cbegin(), shape_u);
+      writer.add("str", str1.cbegin(), {str1.size()}, cnpypp::MemoryOrder::C,
+                 cnpypp::CompressionMethod::Store);
+      writer.add("tuples", {"a", "b"}, tuples.cbegin(), shape_t);
+    }
+
+    cnpypp::npz_t const arrays = cnpypp::npz_load("session.npz");
+    auto const& arr_u = arrays.at("arr_u");
+    auto const& str = arrays.at("str");
+    auto const& tup = arrays.at("tuples");
+    if (arrays.size() != 3 || arr_u.shape != shape_u ||
+        !std::equal(list_u.cbegin(), list_u.cend(), arr_u.data<uint32_t>()) ||
+        !std::equal(str1.cbegin(), str1.cend(), str.data<char>()) ||
+        tup.labels != std::vector<std::string>{"a", "b"} ||
+        tup.num_vals != tuples.size()) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // closed explicitly, further arrays are rejected
+    cnpypp::NpzWriter writer{"session.npz", "a"};
+    writer.add("arr_f", list_f.cbegin(), shape_f);
+    writer.close();
+    try {
+      writer.add("arr_f2", list_f.cbegin(), shape_f);
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    } catch (std::runtime_error const&) {
+    }
+    if (cnpypp::npz_load("session.npz").size() != 4) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // append in place to an archive with a comment
+  {
+    cnpypp::npz_save("comment.npz", "arr_u", list_u.cbegin(), shape_u, "w");
+
+    // the archive ends with the end of central directory record, whose last
+    // field is the length of the comment following it
+    std::string_view const comment = "archive comment";
+    {
+      std::fstream fs{"comment.npz",
+                      std::ios::binary | std::ios::in | std::ios::out};
+      fs.seekp(-2, std::ios::end);
+      uint16_t const length = comment.size();
+      char const length_le[2] = {static_cast<char>(length & 0xff),
+                                 static_cast<char>(length >> 8)};
+      fs.write(length_le, 2);
+      fs.write(comment.data(), comment.size());
+    }
+
+    std::vector<uint32_t> large(1 << 20);
+    std::iota(large.begin(), large.end(), 0u);
+    std::array<uint64_t const, 1> const shape_large{large.size()};
+
+    cnpypp::npz_save("comment.npz", "arr_f", list_f.cbegin(), shape_f, "a");
+    cnpypp::npz_save("comment.npz", "arr_stored", large.cbegin(), shape_large,
+                     "a", cnpypp::MemoryOrder::C,
+                     cnpypp::CompressionMethod::Store);
+    cnpypp::npz_save("comment.npz", "arr_deflated", large.cbegin(),
+                     shape_large, "a", cnpypp::MemoryOrder::C,
+                     cnpypp::CompressionMethod::Deflate, 2);
+
+    // a failing iterator leaves the archive as it was
+    auto const before = read_file("comment.npz");
+    auto const failing = boost::make_transform_iterator(
+        boost::counting_iterator<uint32_t>(0), [](uint32_t i) {
+          if (i == (1 << 19)) {
+            throw std::runtime_error{"iterator failed"};
+          }
+          return i;
+        });
+    for (auto const method : {cnpypp::CompressionMethod::Store,
+                              cnpypp::CompressionMethod::Deflate}) {
+      try {
+        cnpypp::npz_save("comment.npz", "arr_failed", failing, shape_large,
+                         "a", cnpypp::MemoryOrder::C, method);
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      } catch (std::runtime_error const&) {
+      }
+      if (read_file("comment.npz") != before) {
+        std::cerr << "error in line " << __LINE__ << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    std::string_view const tail{before.data() + before.size() - comment.size(),
+                                comment.size()};
+    cnpypp::npz_t const arrays = cnpypp::npz_load("comment.npz");
+    auto const& arr_u = arrays.at("arr_u");
+    auto const& arr_f = arrays.at("arr_f");
+    auto const& stored = arrays.at("arr_stored");
+    auto const& deflated = arrays.at("arr_deflated");
+    if (tail != comment || arrays.size() != 4 ||
+        !std::equal(list_u.cbegin(), list_u.cend(), arr_u.data<uint32_t>()) ||
+        !std::equal(list_f.cbegin(), list_f.cend(), arr_f.data<float>()) ||
+        stored.shape.at(0) != large.size() ||
+        !std::equal(large.cbegin(), large.cend(), stored.data<uint32_t>()) ||
+        deflated.shape.at(0) != large.size() ||
+        !std::equal(large.cbegin(), large.cend(), deflated.data<uint32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 }
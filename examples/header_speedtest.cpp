@@ -0,0 +1,131 @@
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+// reference implementation of the former regex-based header parser,
+// kept here to compare throughput and results with parse_npy_dict()
+static void parse_npy_dict_regex(std::string_view dict,
+                                 std::vector<unsigned>& word_sizes,
+                                 std::vector<char>& data_types,
+                                 std::vector<std::string>& labels,
+                                 std::vector<uint64_t>& shape,
+                                 cnpypp::MemoryOrder& memory_order) {
+  static std::regex const dtype_tuple_regex(
+      "\\('(\\w+)', '([<>|])([a-zA-z])(\\d+)'\\)");
+
+  word_sizes.clear();
+  data_types.clear();
+  labels.clear();
+  shape.clear();
+
+  std::cmatch matches;
+  std::regex_search(dict.begin(), dict.end(), matches,
+                    std::regex{"'fortran_order': (True|False)"});
+  memory_order = (matches[1].str() == "True") ? cnpypp::MemoryOrder::Fortran
+                                              : cnpypp::MemoryOrder::C;
+
+  auto const pos_start_shape = dict.find("'shape': (");
+  auto const pos_end_shape = dict.find(')', pos_start_shape);
+  std::regex digit_re{"\\d+"};
+  for (auto it = std::cregex_iterator(dict.begin() + pos_start_shape,
+                                      dict.begin() + pos_end_shape, digit_re);
+       it != std::cregex_iterator(); ++it) {
+    shape.push_back(std::stoi(it->str()));
+  }
+
+  std::string_view const desc = "'descr': ";
+  auto const pos_start_desc = dict.find(desc);
+  if (dict[pos_start_desc + desc.size()] == '\'') {
+    std::regex_search(dict.begin() + pos_start_desc, dict.end(), matches,
+                      std::regex{"'([<>\\|])([a-zA-z])(\\d+)'"});
+    data_types.push_back(*(matches[2].first));
+    word_sizes.push_back(std::stoi(matches[3].str()));
+  } else {
+    auto const pos_end_list = dict.find(']', pos_start_desc + desc.size());
+    for (auto it = std::cregex_iterator(
+             dict.begin() + pos_start_desc + desc.size(),
+             dict.begin() + pos_end_list, dtype_tuple_regex);
+         it != std::cregex_iterator(); ++it) {
+      labels.emplace_back((*it)[1].str());
+      data_types.push_back(*((*it)[3].first));
+      word_sizes.push_back(std::stoi((*it)[4].str()));
+    }
+  }
+}
+
+int main() {
+  std::array<uint64_t const, 3> const shape{1000, 20, 3};
+  std::array<std::string_view const, 4> const labels{"time", "x", "y", "flag"};
+  std::array<char const, 4> const dtypes{'f', 'f', 'f', 'u'};
+  std::array<size_t const, 4> const sizes{8, 4, 4, 1};
+
+  std::vector<std::vector<char>> const headers{
+      cnpypp::create_npy_header(shape, 'f', 8),
+      cnpypp::create_npy_header(shape, 'i', 4, cnpypp::MemoryOrder::Fortran),
+      cnpypp::create_npy_header(
+          cnpypp::span<uint64_t const>{shape.data(), 1}, labels, dtypes, sizes,
+          cnpypp::MemoryOrder::C)};
+
+  std::vector<unsigned> word_sizes;
+  std::vector<char> data_types;
+  std::vector<std::string> parsed_labels;
+  std::vector<uint64_t> parsed_shape;
+  cnpypp::MemoryOrder memory_order;
+
+  // make sure both implementations agree
+  for (auto const& header : headers) {
+    cnpypp::parse_npy_header(header.data(), word_sizes, data_types,
+                             parsed_labels, parsed_shape, memory_order);
+    auto const ws = word_sizes;
+    auto const dt = data_types;
+    auto const lb = parsed_labels;
+    auto const sh = parsed_shape;
+    auto const mo = memory_order;
+
+    parse_npy_dict_regex(std::string_view{header.data() + 10,
+                                          header.size() - 10},
+                         word_sizes, data_types, parsed_labels, parsed_shape,
+                         memory_order);
+
+    if (ws != word_sizes || dt != data_types || lb != parsed_labels ||
+        sh != parsed_shape || mo != memory_order) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  size_t constexpr iterations = 100000;
+
+  auto const measure = [&](auto&& parse) {
+    auto const begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+      parse(headers[i % headers.size()]);
+    }
+    auto const end = std::chrono::steady_clock::now();
+    return iterations / std::chrono::duration<double>(end - begin).count();
+  };
+
+  double const rate_regex = measure([&](std::vector<char> const& header) {
+    parse_npy_dict_regex(std::string_view{header.data() + 10,
+                                          header.size() - 10},
+                         word_sizes, data_types, parsed_labels, parsed_shape,
+                         memory_order);
+  });
+
+  double const rate_tokenizer = measure([&](std::vector<char> const& header) {
+    cnpypp::parse_npy_header(header.data(), word_sizes, data_types,
+                             parsed_labels, parsed_shape, memory_order);
+  });
+
+  std::cout << "regex     " << rate_regex << " headers/s" << std::endl;
+  std::cout << "tokenizer " << rate_tokenizer << " headers/s" << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// compares loading a (page-cached) file into zero-initialized memory, as
+// InMemoryBuffer used to do, with uninitialized, pooled and huge-page buffers
+// and with memory-mapping in different modes as well as the parallel read of
+// npy_load_parallel()
+
+static size_t constexpr num_elements = 1 << 25; // 256 MiB of doubles
+static int constexpr repetitions = 5;
+static double volatile sink; // keeps the summation from being optimized away
+
+static void print(char const* label, double seconds) {
+  std::cout << label << " " << seconds << " s, "
+            << num_elements * sizeof(double) / seconds / 1e9 << " GB/s"
+            << std::endl;
+}
+
+int main() {
+  {
+    std::vector<double> data(num_elements);
+    std::iota(data.begin(), data.end(), 0.);
+    cnpypp::npy_save("load_speedtest.npy", data.cbegin(), {data.size()}, "w",
+                     cnpypp::MemoryOrder::C, 0, 4096);
+  }
+
+  size_t const num_bytes = num_elements * sizeof(double);
+  size_t const data_offset = 4096;
+
+  auto const read_into = [&](std::byte* dest) {
+    std::ifstream fs{"load_speedtest.npy", std::ios::binary};
+    fs.seekg(data_offset);
+    fs.read(reinterpret_cast<char*>(dest), num_bytes);
+  };
+
+  cnpypp::npy_load("load_speedtest.npy"); // warm up page cache
+
+  auto const average = [](auto&& f) { return measure(f, repetitions); };
+
+  print("zero-filled      ", average([&]() {
+          auto const buffer = std::make_unique<std::byte[]>(num_bytes);
+          read_into(buffer.get());
+        }));
+
+  print("npy_load         ", average([&]() {
+          auto const arr = cnpypp::npy_load("load_speedtest.npy");
+        }));
+
+  for (unsigned const num_threads : {1u, 2u, 4u, 8u}) {
+    std::string const label =
+        "parallel, " + std::to_string(num_threads) + " thr. ";
+    print(label.c_str(), average([&]() {
+            auto const arr =
+                cnpypp::npy_load_parallel("load_speedtest.npy", num_threads);
+          }));
+  }
+
+  cnpypp::BufferPool pool;
+  auto const allocator = pool.allocator();
+  print("npy_load (pooled)", average([&]() {
+          auto const arr = cnpypp::npy_load("load_speedtest.npy", allocator);
+        }));
+  std::cout << "  pool hits: " << pool.hits() << ", misses: " << pool.misses()
+            << std::endl;
+
+  // mapping + summing up all values, lazily faulted in vs. prefaulted
+  auto const sum_mapped = [&](cnpypp::MappingOptions const& options) {
+    auto const arr = cnpypp::npy_load_mapped("load_speedtest.npy", options);
+    auto const* const values = arr.data<double>();
+    sink = std::accumulate(values, values + num_elements, 0.);
+  };
+
+  print("mapped           ", average([&]() {
+          sum_mapped(cnpypp::MappingOptions{});
+        }));
+
+  {
+    cnpypp::MappingOptions options;
+    options.read_only = true;
+    options.advice = cnpypp::MappingOptions::Advice::Sequential;
+    print("mapped, r/o, seq.", average([&]() { sum_mapped(options); }));
+
+    options.populate = true;
+    print("mapped, populate ", average([&]() { sum_mapped(options); }));
+  }
+
+  print("page-aligned     ", average([&]() {
+          cnpypp::InMemoryBuffer buffer{
+              num_bytes, cnpypp::InMemoryBuffer::page_size()};
+          read_into(buffer.data());
+        }));
+
+  print("huge pages       ", average([&]() {
+          cnpypp::InMemoryBuffer buffer{
+              num_bytes, cnpypp::InMemoryBuffer::huge_page_size, true};
+          read_into(buffer.data());
+        }));
+
+  return EXIT_SUCCESS;
+}
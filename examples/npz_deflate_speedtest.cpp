@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// measures npz_save() of a single large deflated array with different numbers
+// of compression threads
+
+int main() {
+  size_t constexpr num_elements = 1 << 21;
+  std::array<uint64_t const, 1> const shape{num_elements};
+
+  // moderately compressible data: slowly rising values plus noise
+  std::vector<int32_t> data(num_elements);
+  uint32_t state = 12345;
+  for (size_t i = 0; i < num_elements; ++i) {
+    state = state * 1664525u + 1013904223u;
+    data[i] = static_cast<int32_t>(i / 16 + (state >> 26));
+  }
+
+  std::string const fname = "npz_deflate_speedtest.npz";
+  double const megabytes = num_elements * sizeof(int32_t) / 1e6;
+
+  for (unsigned num_threads : {1u, 2u, 4u, 8u}) {
+    double const t = measure([&]() {
+      cnpypp::npz_save(fname, "arr", data.cbegin(), shape, "w",
+                       cnpypp::MemoryOrder::C,
+                       cnpypp::CompressionMethod::Deflate, num_threads);
+    });
+
+    auto const arr = cnpypp::npz_load(fname, "arr");
+    if (arr.shape.at(0) != num_elements ||
+        !std::equal(data.cbegin(), data.cend(), arr.data<int32_t>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    auto const file_size = std::filesystem::file_size(fname);
+    std::cout << num_threads << " thread(s): " << t << " s ("
+              << megabytes / t << " MB/s), " << file_size / 1e6 << " MB"
+              << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
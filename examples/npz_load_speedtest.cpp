@@ -0,0 +1,55 @@
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// measures npz_load() on deflated archives of many small and of a few huge
+// arrays
+
+static bool run(std::string const& fname, size_t num_arrays,
+                size_t num_elements) {
+  std::vector<double> data(num_elements);
+  std::array<uint64_t const, 1> const shape{num_elements};
+
+  for (size_t i = 0; i < num_arrays; ++i) {
+    std::iota(data.begin(), data.end(), static_cast<double>(i));
+    cnpypp::npz_save(fname, "arr" + std::to_string(i), data.cbegin(), shape,
+                     i == 0 ? "w" : "a");
+  }
+
+  cnpypp::npz_t arrays;
+  double const t = measure([&]() { arrays = cnpypp::npz_load(fname); });
+
+  for (size_t i = 0; i < num_arrays; ++i) {
+    std::iota(data.begin(), data.end(), static_cast<double>(i));
+    auto const& arr = arrays.at("arr" + std::to_string(i));
+    if (arr.shape.at(0) != num_elements ||
+        !std::equal(data.cbegin(), data.cend(), arr.data<double>())) {
+      return false;
+    }
+  }
+
+  std::cout << num_arrays << " x " << num_elements << " doubles: " << t
+            << " s (" << num_arrays * num_elements * sizeof(double) / t / 1e6
+            << " MB/s)" << std::endl;
+  return true;
+}
+
+int main() {
+  if (!run("npz_load_speedtest_small.npz", 500, 1000)) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!run("npz_load_speedtest_huge.npz", 4, 1 << 23)) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
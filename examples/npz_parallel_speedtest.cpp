@@ -0,0 +1,49 @@
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// compares npz_load() with npz_load_parallel() on an archive of many
+// deflated arrays
+
+static size_t constexpr num_arrays = 32;
+static size_t constexpr num_elements = 1 << 19; // 4 MiB of doubles per array
+
+int main() {
+  std::vector<double> data(num_elements);
+  std::array<uint64_t const, 1> const shape{num_elements};
+
+  for (size_t i = 0; i < num_arrays; ++i) {
+    std::iota(data.begin(), data.end(), static_cast<double>(i));
+    cnpypp::npz_save("npz_parallel_speedtest.npz", "arr" + std::to_string(i),
+                     data.cbegin(), shape, i == 0 ? "w" : "a");
+  }
+
+  cnpypp::npz_t reference;
+  double const t_seq = measure(
+      [&]() { reference = cnpypp::npz_load("npz_parallel_speedtest.npz"); });
+  std::cout << "npz_load                " << t_seq << " s" << std::endl;
+
+  for (unsigned num_threads : {1u, 2u, 4u, 8u}) {
+    cnpypp::npz_t arrays;
+    double const t = measure([&]() {
+      arrays = cnpypp::npz_load_parallel("npz_parallel_speedtest.npz",
+                                         num_threads);
+    });
+
+    if (arrays != reference) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "npz_load_parallel (" << num_threads << ")   " << t << " s"
+              << " (speedup " << t_seq / t << ")" << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+#include <array>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// measures npz_save() without compression of data from contiguous memory,
+// which are copied with memcpy, and from a std::deque, which are copied
+// element by element
+
+template <typename TContainer>
+static bool run(std::string const& name, TContainer const& data) {
+  std::array<uint64_t const, 1> const shape{data.size()};
+  std::string const fname = "npz_store_speedtest_" + name + ".npz";
+
+  double const t = measure([&]() {
+    cnpypp::npz_save(fname, "arr", data.cbegin(), shape, "w",
+                     cnpypp::MemoryOrder::C, cnpypp::CompressionMethod::Store);
+  });
+
+  auto const arr = cnpypp::npz_load(fname, "arr");
+  if (arr.shape.at(0) != data.size() ||
+      !std::equal(data.cbegin(), data.cend(), arr.data<double>())) {
+    return false;
+  }
+
+  std::cout << name << ": " << t << " s ("
+            << data.size() * sizeof(double) / t / 1e6 << " MB/s)" << std::endl;
+  return true;
+}
+
+int main() {
+  std::vector<double> vec(1 << 24);
+  std::iota(vec.begin(), vec.end(), 0.);
+  std::deque<double> const deq(vec.cbegin(), vec.cend());
+
+  if (!run("vector", vec)) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!run("deque", deq)) {
+    std::cerr << "error in line " << __LINE__ << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
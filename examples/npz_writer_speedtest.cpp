@@ -0,0 +1,68 @@
+#include <array>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// compares writing a checkpoint of many arrays with one npz_save() call per
+// array to a single NpzWriter session
+
+static bool verify(std::string const& fname, size_t num_arrays,
+                   std::vector<std::vector<double>> const& arrays) {
+  cnpypp::npz_t const loaded = cnpypp::npz_load(fname);
+  if (loaded.size() != num_arrays) {
+    return false;
+  }
+  for (size_t i = 0; i < num_arrays; ++i) {
+    auto const& arr = loaded.at("arr" + std::to_string(i));
+    if (!std::equal(arrays[i].cbegin(), arrays[i].cend(),
+                    arr.data<double>())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  size_t constexpr num_elements = 1000;
+  std::array<uint64_t const, 1> const shape{num_elements};
+
+  for (size_t num_arrays : {100, 500}) {
+    std::vector<std::vector<double>> arrays(num_arrays,
+                                            std::vector<double>(num_elements));
+    for (size_t i = 0; i < num_arrays; ++i) {
+      std::iota(arrays[i].begin(), arrays[i].end(), static_cast<double>(i));
+    }
+
+    double const t_save = measure([&]() {
+      for (size_t i = 0; i < num_arrays; ++i) {
+        cnpypp::npz_save("npz_writer_speedtest_save.npz",
+                         "arr" + std::to_string(i), arrays[i].cbegin(), shape,
+                         i == 0 ? "w" : "a");
+      }
+    });
+
+    double const t_writer = measure([&]() {
+      cnpypp::NpzWriter writer{"npz_writer_speedtest_writer.npz"};
+      for (size_t i = 0; i < num_arrays; ++i) {
+        writer.add("arr" + std::to_string(i), arrays[i].cbegin(), shape);
+      }
+    });
+
+    if (!verify("npz_writer_speedtest_save.npz", num_arrays, arrays) ||
+        !verify("npz_writer_speedtest_writer.npz", num_arrays, arrays)) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << num_arrays << " arrays: npz_save(): " << t_save
+              << " s, NpzWriter: " << t_writer << " s" << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+
+#include <boost/iterator/counting_iterator.hpp>
+#include <boost/iterator/transform_iterator.hpp>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// measures npy_save() of data generated on the fly by an iterator, writing
+// each chunk after it is generated and generating the next chunks while the
+// previous ones are written
+
+int main() {
+  uint64_t constexpr num_elements = 1 << 25;
+  auto const generate = [](uint64_t i) { return std::sin(i * 1e-3); };
+  auto const first = boost::make_transform_iterator(
+      boost::counting_iterator<uint64_t>(0), generate);
+
+  auto const save = [&](std::optional<cnpypp::PipelineOptions> pipeline) {
+    return measure([&]() {
+      cnpypp::npy_save("pipeline_speedtest.npy", first, {num_elements}, "w",
+                       cnpypp::MemoryOrder::C, 0, 16, pipeline);
+    });
+  };
+
+  double const megabytes = num_elements * sizeof(double) / 1e6;
+  double const t_seq = save(std::nullopt);
+  std::cout << "write_data()                    " << t_seq << " s ("
+            << megabytes / t_seq << " MB/s)" << std::endl;
+
+  for (size_t depth : {2, 4, 8}) {
+    double const t = save(cnpypp::PipelineOptions{0x10000, depth});
+    std::cout << "write_data_pipelined(depth " << depth << ")   " << t
+              << " s (" << megabytes / t << " MB/s)" << std::endl;
+  }
+
+  cnpypp::NpyArray const arr = cnpypp::npy_load("pipeline_speedtest.npy");
+  for (uint64_t i = 0; i < num_elements; i += 4099) {
+    if (arr.data<double>()[i] != generate(i)) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
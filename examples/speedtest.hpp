@@ -0,0 +1,13 @@
+#pragma once
+
+#include <chrono>
+
+// seconds taken by f(), averaged over the given number of repetitions
+template <typename F> double measure(F&& f, int repetitions = 1) {
+  auto const begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < repetitions; ++i) {
+    f();
+  }
+  auto const end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - begin).count() / repetitions;
+}
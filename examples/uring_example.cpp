@@ -0,0 +1,149 @@
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <cnpy++.hpp>
+
+#include "speedtest.hpp"
+
+// saves and loads many arrays with a single UringIO and compares the
+// throughput with sequential npy_save() / npy_load()
+
+static size_t constexpr num_files = 64;
+static size_t constexpr num_elements = 1 << 17; // 1 MiB of doubles per file
+
+static std::string filename(size_t i) {
+  return "uring_example_" + std::to_string(i) + ".npy";
+}
+
+int main() {
+  std::vector<std::vector<double>> data(num_files);
+  for (size_t i = 0; i < num_files; ++i) {
+    data[i].resize(num_elements);
+    std::iota(data[i].begin(), data[i].end(), static_cast<double>(i));
+  }
+  std::array<uint64_t const, 1> const shape{num_elements};
+
+  cnpypp::UringIO uring;
+
+  // save all files at once
+  double const t_save_uring = measure([&]() {
+    std::vector<std::future<void>> results;
+    for (size_t i = 0; i < num_files; ++i) {
+      results.push_back(uring.save(
+          filename(i), cnpypp::span<double const>{data[i].data(), num_elements},
+          shape));
+    }
+    uring.wait();
+    for (auto& r : results) {
+      r.get();
+    }
+  });
+
+  double const t_save_seq = measure([&]() {
+    for (size_t i = 0; i < num_files; ++i) {
+      cnpypp::npy_save(filename(i), data[i].cbegin(), shape, "w");
+    }
+  });
+
+  // load all files at once
+  std::vector<cnpypp::NpyArray> arrays;
+  double const t_load_uring = measure([&]() {
+    std::vector<std::future<cnpypp::NpyArray>> results;
+    for (size_t i = 0; i < num_files; ++i) {
+      results.push_back(uring.load(filename(i)));
+    }
+    uring.wait();
+    for (auto& r : results) {
+      arrays.push_back(r.get());
+    }
+  });
+
+  for (size_t i = 0; i < num_files; ++i) {
+    if (arrays[i].shape.at(0) != num_elements ||
+        !std::equal(data[i].cbegin(), data[i].cend(),
+                    arrays[i].data<double>())) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // load into registered buffers
+  std::vector<double> staging(num_files * num_elements);
+  uring.register_buffers({cnpypp::span<std::byte>{
+      reinterpret_cast<std::byte*>(staging.data()),
+      staging.size() * sizeof(double)}});
+
+  double const t_load_fixed = measure([&]() {
+    std::vector<std::future<cnpypp::NpyArray>> results;
+    for (size_t i = 0; i < num_files; ++i) {
+      results.push_back(uring.load_into(
+          filename(i),
+          cnpypp::span<std::byte>{
+              reinterpret_cast<std::byte*>(&staging[i * num_elements]),
+              num_elements * sizeof(double)}));
+    }
+    uring.wait();
+    for (auto& r : results) {
+      r.get();
+    }
+  });
+
+  for (size_t i = 0; i < num_files; ++i) {
+    if (!std::equal(data[i].cbegin(), data[i].cend(),
+                    &staging[i * num_elements])) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  double const t_load_seq = measure([&]() {
+    for (size_t i = 0; i < num_files; ++i) {
+      cnpypp::npy_load(filename(i));
+    }
+  });
+
+  // single files through the io_uring backend
+  {
+    cnpypp::npy_save_uring("uring_example_single.npy",
+                           cnpypp::span<double const>{data[0].data(),
+                                                      num_elements},
+                           shape);
+    cnpypp::NpyArray const arr =
+        cnpypp::npy_load_uring("uring_example_single.npy");
+    if (!(arr == cnpypp::npy_load(filename(0)))) {
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    try {
+      cnpypp::npy_load_uring("does_not_exist.npy");
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    } catch (std::runtime_error const&) {
+    }
+  }
+
+  // errors are reported through the future
+  {
+    auto result = uring.load("does_not_exist.npy");
+    uring.wait();
+    try {
+      result.get();
+      std::cerr << "error in line " << __LINE__ << std::endl;
+      return EXIT_FAILURE;
+    } catch (std::runtime_error const&) {
+    }
+  }
+
+  std::cout << "save: UringIO " << t_save_uring << " s, npy_save "
+            << t_save_seq << " s" << std::endl;
+  std::cout << "load: UringIO " << t_load_uring << " s, registered buffers "
+            << t_load_fixed << " s, npy_load " << t_load_seq << " s"
+            << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -9,19 +9,27 @@
 #include <array>
 #include <cassert>
 #include <climits>
+#include <condition_variable>
 #include <cstring>
 #include <fstream>
 #include <functional>
+#ifdef CNPYPP_IO_URING
+#include <future>
+#endif
 #include <iomanip>
 #include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -43,6 +51,7 @@
 
 #include <cnpy++.h>
 #include <cnpy++/buffer.hpp>
+#include <cnpy++/column_kernels.hpp>
 #include <cnpy++/map_type.hpp>
 #include <cnpy++/stride_iterator.hpp>
 #include <cnpy++/tuple_util.hpp>
@@ -113,9 +122,9 @@ enum class CompressionMethod {
 struct NpyArray {
   NpyArray(NpyArray&& other)
       : shape{std::move(other.shape)}, word_sizes{std::move(other.word_sizes)},
-        memory_order{other.memory_order}, num_vals{other.num_vals},
-        total_value_size{other.total_value_size}, buffer{std::move(
-                                                      other.buffer)} {}
+        labels{std::move(other.labels)}, memory_order{other.memory_order},
+        num_vals{other.num_vals}, total_value_size{other.total_value_size},
+        buffer{std::move(other.buffer)} {}
 
   NpyArray(std::vector<uint64_t> _shape, std::vector<unsigned> _word_sizes,
            std::vector<std::string> _labels, MemoryOrder _memory_order,
@@ -135,11 +144,24 @@ struct NpyArray {
   }
 
   template <typename T> const T* data() const {
-    return reinterpret_cast<T const*>(buffer->data());
+    return reinterpret_cast<T const*>(readable_data());
   }
 
   uint64_t num_bytes() const { return num_vals * total_value_size; }
 
+  // copies every field into a separate contiguous array with 64-byte aligned
+  // data. see from_columns() for the reverse
+  std::vector<NpyArray> to_columns() const;
+
+  // writes modified data in the byte range [offset, offset + length) back to
+  // the file if the array is mapped writable (see npy_create_mapped()),
+  // does nothing otherwise
+  void flush(uint64_t offset = 0,
+             uint64_t length = std::numeric_limits<uint64_t>::max()) {
+    offset = std::min(offset, num_bytes());
+    buffer->flush(offset, std::min(length, num_bytes() - offset));
+  }
+
   bool compare_metadata(NpyArray const& other) const {
     return shape == other.shape && word_sizes == other.word_sizes &&
            labels == other.labels && memory_order == other.memory_order;
@@ -193,10 +215,34 @@ struct NpyArray {
           "tuple_range: word sizes do not match requested types");
     } else {
       return subrange{
-          tuple_iterator<add_const_t<std::tuple<TArgs...>>>{buffer.get()},
+          tuple_iterator<add_const_t<std::tuple<TArgs...>>>{readable_data()},
           tuple_iterator<add_const_t<std::tuple<TArgs...>>>{
-              buffer->data() + num_vals * total_value_size}};
+              readable_data() + num_vals * total_value_size}};
+    }
+  }
+
+  // describes a field for the column kernels (column_sum() etc.)
+  template <typename TValueType>
+  column_view<TValueType> column(std::string_view name) const {
+    auto const it = std::find(labels.cbegin(), labels.cend(), name);
+    if (it == labels.cend()) {
+      std::stringstream ss;
+      ss << "column: " << std::quoted(name) << " not found in labels";
+      throw std::runtime_error{ss.str()};
+    }
+
+    std::ptrdiff_t const d = std::distance(labels.cbegin(), it);
+    if (word_sizes.at(d) != sizeof(TValueType)) {
+      throw std::runtime_error{
+          "column: word sizes of requested type and data do not match"};
     }
+
+    ptrdiff_t const offset =
+        std::accumulate(word_sizes.cbegin(), std::next(word_sizes.cbegin(), d),
+                        std::ptrdiff_t{0});
+    return column_view<TValueType>{
+        readable_data() + offset,
+        static_cast<std::ptrdiff_t>(total_value_size), num_vals};
   }
 
   template <typename TValueType>
@@ -222,9 +268,9 @@ struct NpyArray {
           std::accumulate(word_sizes.cbegin(),
                           std::next(word_sizes.cbegin(), d), std::ptrdiff_t{0});
 
-      auto beg =
-          stride_iterator<TValueType>{buffer.get() + offset, total_value_size};
-      auto end = stride_iterator<TValueType>{buffer.get() + offset +
+      auto beg = stride_iterator<TValueType>{buffer->data() + offset,
+                                             total_value_size};
+      auto end = stride_iterator<TValueType>{buffer->data() + offset +
                                                  total_value_size * num_vals,
                                              total_value_size};
       return subrange{beg, end};
@@ -251,10 +297,10 @@ struct NpyArray {
           std::accumulate(word_sizes.cbegin(),
                           std::next(word_sizes.cbegin(), d), std::ptrdiff_t{0});
 
-      auto beg = stride_iterator<TValueType const>{buffer.get() + offset,
+      auto beg = stride_iterator<TValueType const>{readable_data() + offset,
                                                    total_value_size};
       auto end = stride_iterator<TValueType const>{
-          buffer.get() + offset + total_value_size * num_vals,
+          readable_data() + offset + total_value_size * num_vals,
           total_value_size};
       return subrange{beg, end};
     }
@@ -270,6 +316,12 @@ struct NpyArray {
 private:
   std::unique_ptr<Buffer> buffer;
 
+  // for read access only, through the const Buffer::data(). the iterators
+  // over const values take a non-const pointer but do not write through it
+  std::byte* readable_data() const {
+    return const_cast<std::byte*>(std::as_const(*buffer).data());
+  }
+
   template <typename... TArgs> bool compare_word_sizes() const {
     auto const& requested_type_sizes =
         tuple_info<std::tuple<TArgs...>>::element_sizes;
@@ -281,19 +333,59 @@ private:
 
 using npz_t = std::map<std::string, NpyArray>;
 
+// interleaves non-structured arrays of equal shape into a structured array
+// with the fields named by labels
+NpyArray from_columns(cnpypp::span<NpyArray const> columns,
+                      cnpypp::span<std::string_view const> labels);
+
+// metadata of an array as stored in the header of an NPY file
+struct NpyHeader {
+  std::vector<uint64_t> shape;
+  std::vector<unsigned> word_sizes;
+  std::vector<char> data_types;
+  std::vector<std::string> labels;
+  MemoryOrder memory_order;
+
+  uint64_t num_vals() const {
+    return std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                           std::multiplies<uint64_t>{});
+  }
+
+  uint64_t num_bytes() const {
+    return num_vals() * std::accumulate(word_sizes.begin(), word_sizes.end(),
+                                        uint64_t{0}, std::plus<uint64_t>{});
+  }
+};
+
 char BigEndianTest();
 
 bool _exists(std::string const&); // calls boost::filesystem::exists()
 
+// header_capacity > 0 reserves enough space in the header to store any shape
+// of the same rank, with a total header size of at least header_capacity bytes.
+// the header is padded to a multiple of data_alignment (a power of 2), which
+// is the alignment of the data following it. headers longer than 64 KiB are
+// written in NPY format version 2.0.
 std::vector<char> create_npy_header(cnpypp::span<uint64_t const> shape,
                                     char dtype, unsigned size,
-                                    MemoryOrder = MemoryOrder::C);
+                                    MemoryOrder = MemoryOrder::C,
+                                    size_t header_capacity = 0,
+                                    size_t data_alignment = 16);
 
 std::vector<char> create_npy_header(cnpypp::span<uint64_t const> shape,
                                     cnpypp::span<std::string_view const> labels,
                                     cnpypp::span<char const> dtypes,
                                     cnpypp::span<size_t const> sizes,
-                                    MemoryOrder memory_order);
+                                    MemoryOrder memory_order,
+                                    size_t header_capacity = 0,
+                                    size_t data_alignment = 16);
+
+// replaces the header of size header_size at the beginning of an NPY file
+// followed by payload_bytes bytes of data. if the new header fits, it is
+// padded to header_size and patched in place, otherwise the payload is moved.
+// returns the size of the new header.
+size_t update_npy_header(std::fstream& fs, std::vector<char> header,
+                         size_t header_size, uint64_t payload_bytes);
 
 void parse_npy_header(std::istream& fs, std::vector<unsigned>& word_sizes,
                       std::vector<char>& data_types,
@@ -307,6 +399,10 @@ void parse_npy_header(std::istream::char_type const* buffer,
                       std::vector<std::string>& labels,
                       std::vector<uint64_t>& shape, MemoryOrder& memory_order);
 
+// returns the total size of the header (preamble and dict) of an NPY file,
+// given at least its first 12 bytes
+size_t npy_header_size(std::istream::char_type const* preamble);
+
 void parse_npy_dict(cnpypp::span<std::istream::char_type const> buffer,
                     std::vector<unsigned>& word_sizes,
                     std::vector<char>& data_types,
@@ -314,12 +410,256 @@ void parse_npy_dict(cnpypp::span<std::istream::char_type const> buffer,
                     std::vector<uint64_t>& shape,
                     cnpypp::MemoryOrder& memory_order);
 
-npz_t npz_load(std::string const& fname);
+// an allocator (e.g. BufferPool::allocator()) may be provided to supply the
+// memory for the payloads instead of allocating a new InMemoryBuffer per array
+npz_t npz_load(std::string const& fname, BufferAllocator const& allocator = {});
+
+NpyArray npz_load(std::string const& fname, std::string const& varname,
+                  BufferAllocator const& allocator = {});
 
-NpyArray npz_load(std::string const& fname, std::string const& varname);
+// maps the data of a stored (CompressionMethod::Store) array directly from
+// the archive like npy_load_mapped() instead of copying them, so that
+// opening even large archives is instantaneous. compressed arrays are
+// decompressed into memory as usual.
+NpyArray npz_load_mapped(std::string const& fname, std::string const& varname,
+                         MappingOptions const& options = {});
+
+// like npz_load(fname), but decompresses the arrays concurrently with
+// num_threads threads, each using its own handle of the archive.
+// num_threads = 0 selects std::thread::hardware_concurrency(). the allocator
+// has to be thread-safe
+npz_t npz_load_parallel(std::string const& fname, unsigned num_threads = 0,
+                        BufferAllocator const& allocator = {});
 
 NpyArray npy_load(std::string const& fname, bool memory_mapped = false);
 
+// memory-maps the data as described by options
+NpyArray npy_load_mapped(std::string const& fname,
+                         MappingOptions const& options = {});
+
+NpyArray npy_load(std::string const& fname, BufferAllocator const& allocator);
+
+// load the payload directly into dest, which has to be large enough to hold
+// it. the returned array refers to dest and must not outlive it.
+NpyArray npy_load_into(std::string const& fname, cnpypp::span<std::byte> dest);
+
+NpyArray npz_load_into(std::string const& fname, std::string const& varname,
+                       cnpypp::span<std::byte> dest);
+
+// reads the payload with num_threads concurrent positional reads (pread())
+// of chunk_size bytes each, which makes better use of fast storage (NVMe
+// drives, RAID arrays) than a single stream. num_threads = 0 selects
+// std::thread::hardware_concurrency()
+NpyArray npy_load_parallel(std::string const& fname, unsigned num_threads = 0,
+                           size_t chunk_size = 0x400000,
+                           BufferAllocator const& allocator = {});
+
+// loads only the fields named in labels of a structured array, packed into a
+// structured array with these fields in the given order. the data are read
+// from a mapping, so that pages containing none of the fields are skipped if
+// the records are large enough.
+NpyArray npy_load_columns(std::string const& fname,
+                          cnpypp::span<std::string_view const> labels,
+                          BufferAllocator const& allocator = {});
+
+// like npy_load_columns(), but returns every field as a separate contiguous
+// (non-structured) array, in the order of labels
+std::vector<NpyArray>
+npy_load_column_arrays(std::string const& fname,
+                       cnpypp::span<std::string_view const> labels,
+                       BufferAllocator const& allocator = {});
+
+// count indices start, start + stride, ..., start + (count - 1) * stride
+// along one axis of an array
+struct AxisSelection {
+  uint64_t start = 0;
+  uint64_t count = 0;
+  uint64_t stride = 1;
+};
+
+// reads the hyperslab given by one AxisSelection per axis into a dense array
+// of shape {count, ...} in the memory order of the file. the selection is
+// split into contiguous runs of bytes; runs less than 64 KiB apart are read
+// together, and the reads are distributed over num_threads threads
+// (0 selects std::thread::hardware_concurrency())
+NpyArray npy_load_hyperslab(std::string const& fname,
+                            cnpypp::span<AxisSelection const> selection,
+                            unsigned num_threads = 1,
+                            BufferAllocator const& allocator = {});
+
+// reads only the rows [first, first + count) along the first axis. the
+// returned array has the leading dimension count. not possible for
+// multi-dimensional arrays in Fortran order, as their rows are not contiguous.
+NpyArray npy_load_rows(std::string const& fname, uint64_t first,
+                       uint64_t count, BufferAllocator const& allocator = {});
+
+// maps only the pages containing the rows
+NpyArray npy_load_rows_mapped(std::string const& fname, uint64_t first,
+                              uint64_t count,
+                              MappingOptions const& options = {});
+
+// creates an NPY file of the given shape and data type, allocates the disk
+// space for the data and maps them shared and writable, so that the array can
+// be filled in place (also from multiple threads) without holding a copy in
+// memory. the content of the data is unspecified (zero for new files).
+// modifications reach the file at the latest when the array is destroyed or
+// flush() is called. data_alignment as for npy_save().
+NpyArray npy_create_mapped(std::string const& fname,
+                           cnpypp::span<uint64_t const> shape, char dtype,
+                           unsigned size,
+                           MemoryOrder memory_order = MemoryOrder::C,
+                           size_t data_alignment = 16);
+
+NpyArray npy_create_mapped(std::string const& fname,
+                           cnpypp::span<uint64_t const> shape,
+                           cnpypp::span<std::string_view const> labels,
+                           cnpypp::span<char const> dtypes,
+                           cnpypp::span<size_t const> sizes,
+                           MemoryOrder memory_order = MemoryOrder::C,
+                           size_t data_alignment = 16);
+
+template <typename T>
+NpyArray npy_create_mapped(std::string const& fname,
+                           cnpypp::span<uint64_t const> shape,
+                           MemoryOrder memory_order = MemoryOrder::C,
+                           size_t data_alignment = 16) {
+  return npy_create_mapped(fname, shape, map_type(T{}), sizeof(T),
+                           memory_order, data_alignment);
+}
+
+// maps the data of an existing NPY file shared and writable for in-place
+// modification
+NpyArray npy_open_mapped_rw(std::string const& fname);
+
+#ifndef NO_LIBZIP
+// opens an NPZ archive once and reads headers and data of its arrays only on
+// demand. arrays obtained by get() are kept in a cache until they are evicted
+// or the reader is destroyed; load() always returns a new copy. not
+// thread-safe.
+class NpzReader {
+public:
+  explicit NpzReader(std::string const& fname);
+
+  // names of the arrays (without ".npy") in the order of the archive
+  std::vector<std::string> const& names() const { return member_names; }
+
+  bool contains(std::string const& name) const;
+
+  // reads and parses only the header of the array
+  NpyHeader const& header(std::string const& name);
+
+  NpyArray load(std::string const& name, BufferAllocator const& allocator = {});
+
+  // see npz_load_mapped()
+  NpyArray map(std::string const& name, MappingOptions const& options = {});
+
+  // the reference stays valid until the array is evicted
+  NpyArray const& get(std::string const& name);
+
+  bool is_cached(std::string const& name) const;
+  void evict(std::string const& name);
+  void clear_cache();
+
+private:
+  struct Member {
+    zip_int64_t index;
+    std::optional<NpyHeader> header;
+    std::optional<NpyArray> array;
+  };
+
+  Member& member(std::string const& name);
+
+  std::string fname;
+  std::unique_ptr<zip_t, void (*)(zip_t*)> archive;
+  std::vector<std::string> member_names;
+  std::map<std::string, Member> members;
+  std::map<std::string, uint64_t> local_header_offsets; // read by map()
+};
+#endif
+
+#ifdef CNPYPP_IO_URING
+// loads and saves NPY files asynchronously via io_uring (Linux only, requires
+// building with CNPYPP_USE_LIBURING). load() and save() only queue a request;
+// wait() submits the reads and writes of all queued requests in batches and
+// processes their completions until all are done, so that many files are in
+// flight at once from a single thread. results are delivered through the
+// returned futures. not thread-safe.
+class UringIO {
+public:
+  explicit UringIO(unsigned queue_depth = 64, size_t chunk_size = 0x400000);
+  UringIO(UringIO const&) = delete;
+  UringIO& operator=(UringIO const&) = delete;
+  ~UringIO();
+
+  // registers buffers with the kernel, so that reads of payloads located
+  // inside them (see load_into()) use pre-mapped pages. replaces previously
+  // registered buffers
+  void register_buffers(std::vector<cnpypp::span<std::byte>> const& buffers);
+
+  std::future<NpyArray> load(std::string fname,
+                             BufferAllocator allocator = {});
+
+  // the returned array refers to dest, see npy_load_into()
+  std::future<NpyArray> load_into(std::string fname,
+                                  cnpypp::span<std::byte> dest);
+
+  // writes a header created by create_npy_header() followed by data. the data
+  // need to stay valid until the request is completed
+  std::future<void> save(std::string fname, std::vector<char> header,
+                         cnpypp::span<std::byte const> data);
+
+  template <typename T>
+  std::future<void> save(std::string fname, cnpypp::span<T const> data,
+                         cnpypp::span<uint64_t const> shape,
+                         MemoryOrder memory_order = MemoryOrder::C) {
+    if (std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                        std::multiplies<uint64_t>{}) != data.size()) {
+      throw std::runtime_error("UringIO::save: shape does not match data");
+    }
+    return save(std::move(fname),
+                create_npy_header(shape, map_type(T{}), sizeof(T),
+                                  memory_order),
+                cnpypp::span<std::byte const>{
+                    reinterpret_cast<std::byte const*>(data.data()),
+                    data.size() * sizeof(T)});
+  }
+
+  // processes all queued requests. throws if the ring fails, which fails
+  // all unfinished and later requests as well
+  void wait();
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+// like npy_load(), but reads the payload through a UringIO, i.e. in chunks
+// with several reads in flight. falls back to npy_load() if io_uring cannot
+// be set up, e.g. where it is disabled for containers
+NpyArray npy_load_uring(std::string const& fname,
+                        BufferAllocator const& allocator = {});
+
+// writes a header created by create_npy_header() followed by data through a
+// UringIO, with the same fallback. only for contiguous data, unlike npy_save()
+void npy_save_uring(std::string const& fname, std::vector<char> header,
+                    cnpypp::span<std::byte const> data);
+
+template <typename T>
+void npy_save_uring(std::string const& fname, cnpypp::span<T const> data,
+                    cnpypp::span<uint64_t const> shape,
+                    MemoryOrder memory_order = MemoryOrder::C) {
+  if (std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                      std::multiplies<uint64_t>{}) != data.size()) {
+    throw std::runtime_error("npy_save_uring: shape does not match data");
+  }
+  npy_save_uring(
+      fname, create_npy_header(shape, map_type(T{}), sizeof(T), memory_order),
+      cnpypp::span<std::byte const>{
+          reinterpret_cast<std::byte const*>(data.data()),
+          data.size() * sizeof(T)});
+}
+#endif
+
 template <typename TConstInputIterator>
 bool constexpr is_contiguous_v =
 #if __cpp_lib_concepts >= 202002L
@@ -417,6 +757,145 @@ void write_data_tuple(TTupleIterator start, uint64_t nels, std::ostream& fs) {
   }
 }
 
+// buffering of write_data_pipelined() and write_data_tuple_pipelined()
+struct PipelineOptions {
+  size_t chunk_size = 0x10000; // elements per buffer
+  size_t depth = 2;            // number of buffers
+};
+
+namespace detail {
+// produce(buffer, count) serializes the next count elements into the buffer.
+// it is called on the calling thread to fill a ring of options.depth buffers
+// of options.chunk_size elements each, while another thread writes the filled
+// buffers to fs in order, so that generating and writing the data overlap
+template <typename Produce>
+void write_pipelined(uint64_t nels, size_t element_size,
+                     PipelineOptions const& options, std::ostream& fs,
+                     Produce&& produce) {
+  size_t const chunk_size = static_cast<size_t>(std::clamp<uint64_t>(
+      options.chunk_size, 1, std::max<uint64_t>(nels, 1)));
+  size_t const depth = std::max<size_t>(options.depth, 1);
+  uint64_t const num_chunks = (nels + chunk_size - 1) / chunk_size;
+  auto const chunk_elements = [&](uint64_t chunk) {
+    return static_cast<size_t>(
+        std::min<uint64_t>(chunk_size, nels - chunk * chunk_size));
+  };
+
+  std::vector<std::unique_ptr<char[]>> buffers(depth);
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint64_t chunks_filled = 0, chunks_written = 0;
+  bool aborted = false;
+
+  auto writer = std::async(std::launch::async, [&]() {
+    try {
+      for (uint64_t c = 0; c < num_chunks; ++c) {
+        {
+          std::unique_lock lock{mutex};
+          cv.wait(lock, [&]() { return chunks_filled > c || aborted; });
+          if (aborted) {
+            return;
+          }
+        }
+        fs.write(buffers[c % depth].get(), chunk_elements(c) * element_size);
+        {
+          std::lock_guard lock{mutex};
+          ++chunks_written;
+        }
+        cv.notify_all();
+      }
+    } catch (...) {
+      {
+        std::lock_guard lock{mutex};
+        aborted = true;
+      }
+      cv.notify_all();
+      throw;
+    }
+  });
+
+  try {
+    for (uint64_t c = 0; c < num_chunks; ++c) {
+      {
+        std::unique_lock lock{mutex};
+        cv.wait(lock, [&]() { return c - chunks_written < depth || aborted; });
+        if (aborted) {
+          break;
+        }
+      }
+      auto& buffer = buffers[c % depth];
+      if (!buffer) {
+        buffer = std::make_unique<char[]>(chunk_size * element_size);
+      }
+      produce(buffer.get(), chunk_elements(c));
+      {
+        std::lock_guard lock{mutex};
+        ++chunks_filled;
+      }
+      cv.notify_all();
+    }
+  } catch (...) {
+    {
+      std::lock_guard lock{mutex};
+      aborted = true;
+    }
+    cv.notify_all();
+    writer.wait();
+    throw;
+  }
+
+  writer.get();
+}
+} // namespace detail
+
+// like write_data(), but generates the data from the iterator while the
+// previous chunks are written (see PipelineOptions). without a second
+// hardware thread, both would only take turns, so write_data() is used
+template <typename TConstInputIterator>
+void write_data_pipelined(TConstInputIterator start, uint64_t nels,
+                          std::ostream& fs,
+                          PipelineOptions const& options = {}) {
+  using value_type =
+      typename std::iterator_traits<TConstInputIterator>::value_type;
+
+  if constexpr (is_contiguous_v<TConstInputIterator>) {
+    write_data(start, nels, fs);
+  } else if (std::thread::hardware_concurrency() <= 1) {
+    write_data(start, nels, fs);
+  } else {
+    detail::write_pipelined(
+        nels, sizeof(value_type), options, fs,
+        [it = start](char* buffer, size_t count) mutable {
+          for (size_t i = 0; i < count; ++i, ++it) {
+            value_type const value = *it;
+            std::memcpy(buffer + i * sizeof(value_type), &value,
+                        sizeof(value_type));
+          }
+        });
+  }
+}
+
+// same for tuples, see write_data_tuple()
+template <typename TTupleIterator>
+void write_data_tuple_pipelined(TTupleIterator start, uint64_t nels,
+                                std::ostream& fs,
+                                PipelineOptions const& options = {}) {
+  using value_type = typename std::iterator_traits<TTupleIterator>::value_type;
+  static auto constexpr sum = tuple_info<value_type>::sum_sizes;
+
+  if (std::thread::hardware_concurrency() <= 1) {
+    write_data_tuple(start, nels, fs);
+    return;
+  }
+
+  detail::write_pipelined(nels, sum, options, fs,
+                          [it = start](char* buffer, size_t count) mutable {
+                            for (size_t i = 0; i < count; ++i, ++it) {
+                              fill<value_type>(*it, buffer + i * sum);
+                            }
+                          });
+}
+
 template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
 std::vector<char>& operator+=(std::vector<char>& lhs, const T rhs) {
   // write in little endian
@@ -437,10 +916,14 @@ template <typename TConstInputIterator>
 void npy_save(std::string const& fname, TConstInputIterator start,
               cnpypp::span<uint64_t const> const shape,
               std::string_view mode = "w",
-              MemoryOrder memory_order = MemoryOrder::C) {
+              MemoryOrder memory_order = MemoryOrder::C,
+              size_t header_capacity = 0, size_t data_alignment = 16,
+              std::optional<PipelineOptions> const& pipeline = std::nullopt) {
   std::fstream fs;
   std::vector<uint64_t>
       true_data_shape; // if appending, the shape of existing + new data
+  size_t header_size = 0; // if appending, size of the existing header
+  uint64_t payload_bytes = 0;
 
   using value_type =
       typename std::iterator_traits<TConstInputIterator>::value_type;
@@ -464,6 +947,10 @@ void npy_save(std::string const& fname, TConstInputIterator start,
     parse_npy_header(fs, word_sizes_exist, data_types_exist, labels_exist,
                      true_data_shape, memory_order_exist);
 
+    header_size = fs.tellg();
+    fs.seekg(0, std::ios_base::end);
+    payload_bytes = static_cast<uint64_t>(fs.tellg()) - header_size;
+
     if (sizeof(value_type) != word_sizes_exist.at(0)) {
       throw std::runtime_error{
           "npy_save(): appending failed: element size not matching"};
@@ -499,29 +986,40 @@ void npy_save(std::string const& fname, TConstInputIterator start,
     true_data_shape = std::vector<uint64_t>{shape.begin(), shape.end()};
   }
 
-  std::vector<char> const header =
+  std::vector<char> header =
       create_npy_header(true_data_shape, map_type(value_type{}),
-                        sizeof(value_type), memory_order);
+                        sizeof(value_type), memory_order, header_capacity,
+                        data_alignment);
   uint64_t const nels = std::accumulate(shape.begin(), shape.end(), 1,
                                         std::multiplies<uint64_t>{});
 
-  fs.seekp(0, std::ios_base::beg);
-  fs.write(&header[0], sizeof(char) * header.size());
+  if (header_size > 0) {
+    // patch the existing header, moving the data only if necessary
+    update_npy_header(fs, std::move(header), header_size, payload_bytes);
+  } else {
+    fs.write(&header[0], sizeof(char) * header.size());
+  }
   fs.seekp(0, std::ios_base::end);
 
   // now write actual data
-  write_data(start, nels, fs);
+  if (pipeline) {
+    write_data_pipelined(start, nels, fs, *pipeline);
+  } else {
+    write_data(start, nels, fs);
+  }
 }
 
 template <typename TConstInputIterator>
 void npy_save(std::string const& fname, TConstInputIterator start,
               std::initializer_list<uint64_t> const shape,
               std::string_view mode = "w",
-              MemoryOrder memory_order = MemoryOrder::C) {
+              MemoryOrder memory_order = MemoryOrder::C,
+              size_t header_capacity = 0, size_t data_alignment = 16,
+              std::optional<PipelineOptions> const& pipeline = std::nullopt) {
   npy_save<TConstInputIterator>(
       fname, start,
       cnpypp::span<uint64_t const>{std::data(shape), shape.size()}, mode,
-      memory_order);
+      memory_order, header_capacity, data_alignment, pipeline);
 }
 
 #ifndef NO_LIBZIP
@@ -532,17 +1030,27 @@ prepare_npz(std::string const& zipname,
 
 #ifndef NO_LIBZIP
 void finalize_npz(zip_t*, std::string, detail::additional_parameters&,
-                  CompressionMethod);
+                  CompressionMethod, unsigned num_threads = 1);
 #endif
 
 #ifndef NO_LIBZIP
+// writes an array into the archive like prepare_npz() and finalize_npz(), but
+// appends to existing archives without rewriting them if possible
+void save_npz(std::string const& zipname, std::string const& fname,
+              detail::additional_parameters&,
+              cnpypp::span<uint64_t const> const shape, std::string_view mode,
+              CompressionMethod, unsigned num_threads);
+#endif
+
+#ifndef NO_LIBZIP
+namespace detail {
+// NPY stream of an array for npzwrite_source_callback(). the iterator is
+// copied and advanced only while libzip reads the data
 template <typename TConstInputIterator>
-void npz_save(std::string const& zipname, std::string const& fname,
-              TConstInputIterator start,
-              cnpypp::span<uint64_t const> const shape,
-              std::string_view mode = "w",
-              MemoryOrder memory_order = MemoryOrder::C,
-              CompressionMethod compr_method = CompressionMethod::Deflate) {
+std::unique_ptr<additional_parameters>
+make_npz_source(TConstInputIterator start,
+                cnpypp::span<uint64_t const> const shape,
+                MemoryOrder memory_order) {
   using value_type =
       typename std::iterator_traits<TConstInputIterator>::value_type;
   size_t constexpr wordsize = sizeof(value_type);
@@ -552,55 +1060,73 @@ void npz_save(std::string const& zipname, std::string const& fname,
   static_assert(sizeof(value_type) == 1 || !std::is_same_v<value_type, bool>,
                 "platforms with sizeof(bool) != 1 not supported");
 
-  auto [nels, archive] = prepare_npz(zipname, shape, mode);
-  auto const Nels = nels; // clang++ can't capture nels in lambda (?)
-
-  uint64_t elements_written_total = 0;
-
-  auto callback = [&it = start, nels = Nels, wordsize, &elements_written_total](
-                      cnpypp::span<char> libzip_buffer,
-                      detail::additional_parameters* parameters) -> size_t {
-    size_t const n_tbw = static_cast<size_t>(std::min<uint64_t>(
-        libzip_buffer.size() / wordsize, nels - elements_written_total));
-    value_type* libzip_word_buffer =
-        reinterpret_cast<value_type*>(libzip_buffer.data());
-
-    for (size_t i = 0; i < n_tbw; ++i) {
-      libzip_word_buffer[i] = *(it++);
-    }
-
-    elements_written_total += n_tbw;
+  uint64_t const nels = std::accumulate(shape.begin(), shape.end(),
+                                        uint64_t{1}, std::multiplies<>());
+
+  auto header =
+      create_npy_header(shape, map_type(value_type{}), wordsize, memory_order);
+
+  if constexpr (is_contiguous_v<TConstInputIterator>) {
+    // serve each request with a single memcpy from the source memory, which
+    // may end in the middle of an element
+    char const* const data =
+        nels ? reinterpret_cast<char const*>(&*start) : nullptr;
+    uint64_t const num_bytes = nels * wordsize;
+
+    auto callback = [data, num_bytes, bytes_written_total = uint64_t{0}](
+                        cnpypp::span<char> libzip_buffer,
+                        additional_parameters*) mutable -> size_t {
+      size_t const n = static_cast<size_t>(std::min<uint64_t>(
+          libzip_buffer.size(), num_bytes - bytes_written_total));
+      if (n) {
+        std::memcpy(libzip_buffer.data(), data + bytes_written_total, n);
+      }
+      bytes_written_total += n;
+      return n;
+    };
+
+    return std::make_unique<additional_parameters>(std::move(header), wordsize,
+                                                   callback);
+  } else {
+    auto callback = [it = start, nels, elements_written_total = uint64_t{0}](
+                        cnpypp::span<char> libzip_buffer,
+                        additional_parameters* parameters) mutable -> size_t {
+      size_t const n_tbw = static_cast<size_t>(std::min<uint64_t>(
+          libzip_buffer.size() / wordsize, nels - elements_written_total));
+      value_type* libzip_word_buffer =
+          reinterpret_cast<value_type*>(libzip_buffer.data());
+
+      for (size_t i = 0; i < n_tbw; ++i) {
+        libzip_word_buffer[i] = *(it++);
+      }
 
-    if (elements_written_total < nels &&
-        libzip_buffer.size() > wordsize * n_tbw) {
-      // some space left that could not be filled with a single element
-      // write one into temp. buffer
-      auto* const tmp = reinterpret_cast<value_type*>(&parameters->buffer[0]);
-      *tmp = *(it++);
-      parameters->buffer_size = wordsize;
+      elements_written_total += n_tbw;
 
-      ++elements_written_total;
-    }
+      if (elements_written_total < nels &&
+          libzip_buffer.size() > wordsize * n_tbw) {
+        // some space left that could not be filled with a single element
+        // write one into temp. buffer
+        auto* const tmp = reinterpret_cast<value_type*>(&parameters->buffer[0]);
+        *tmp = *(it++);
+        parameters->buffer_size = wordsize;
 
-    return n_tbw * wordsize; // number of bytes written to libzip's buffer
-  };
+        ++elements_written_total;
+      }
 
-  detail::additional_parameters parameters{
-      create_npy_header(shape, map_type(value_type{}), wordsize, memory_order),
-      wordsize, callback};
+      return n_tbw * wordsize; // number of bytes written to libzip's buffer
+    };
 
-  finalize_npz(archive, fname, parameters, compr_method);
+    return std::make_unique<additional_parameters>(std::move(header), wordsize,
+                                                   callback);
+  }
 }
-#endif
 
-#ifndef NO_LIBZIP
+// same for structured arrays
 template <typename TTupleIterator>
-void npz_save(std::string const& zipname, std::string const& fname,
-              std::vector<std::string_view> const& labels, TTupleIterator first,
-              cnpypp::span<uint64_t const> const shape,
-              std::string_view mode = "w",
-              MemoryOrder memory_order = MemoryOrder::C,
-              CompressionMethod compr_method = CompressionMethod::Deflate) {
+std::unique_ptr<additional_parameters>
+make_npz_source(std::vector<std::string_view> const& labels,
+                TTupleIterator first, cnpypp::span<uint64_t const> const shape,
+                MemoryOrder memory_order) {
   using value_type = typename std::iterator_traits<TTupleIterator>::value_type;
 
   // forbid implementations of std::bool with sizeof(bool) != 1
@@ -617,18 +1143,12 @@ void npz_save(std::string const& zipname, std::string const& fname,
   static auto constexpr sizes = tuple_info<value_type>::element_sizes;
   auto constexpr sum_size = tuple_info<value_type>::sum_sizes;
 
-  // forbid implementations of std::bool with sizeof(bool) != 1
-  // numpy can't handle these
-  static_assert(sizeof(bool) == 1 || !tuple_info<value_type>::has_bool_element,
-                "platforms with sizeof(bool) != 1 not supported");
-
-  auto [nels, archive] = prepare_npz(zipname, shape, mode);
-  auto const Nels = nels; // clang++ can't capture nels in lambda (?)
-  uint64_t elements_written_total = 0;
+  uint64_t const nels = std::accumulate(shape.begin(), shape.end(),
+                                        uint64_t{1}, std::multiplies<>());
 
-  auto callback = [&it = first, nels = Nels, sum_size, &elements_written_total](
+  auto callback = [it = first, nels, elements_written_total = uint64_t{0}](
                       cnpypp::span<char> libzip_buffer,
-                      detail::additional_parameters* parameters) -> size_t {
+                      additional_parameters* parameters) mutable -> size_t {
     size_t const n_tbw = static_cast<size_t>(std::min<uint64_t>(
         libzip_buffer.size() / sum_size, nels - elements_written_total));
 
@@ -643,7 +1163,6 @@ void npz_save(std::string const& zipname, std::string const& fname,
         libzip_buffer.size() > sum_size * n_tbw) {
       // some space left that could not be filled with a single element
       // write one into temp. buffer
-      char* const tmp = reinterpret_cast<char*>(&parameters->buffer[0]);
       auto const& tup = *(it++);
       fill<value_type>(tup, parameters->buffer.get());
       parameters->buffer_size = sum_size;
@@ -654,11 +1173,41 @@ void npz_save(std::string const& zipname, std::string const& fname,
     return n_tbw * sum_size; // number of bytes written to libzip's buffer
   };
 
-  detail::additional_parameters parameters{
+  return std::make_unique<additional_parameters>(
       create_npy_header(shape, labels, dtypes, sizes, memory_order), sum_size,
-      callback};
+      callback);
+}
+} // namespace detail
+#endif
 
-  finalize_npz(archive, fname, parameters, compr_method);
+#ifndef NO_LIBZIP
+template <typename TConstInputIterator>
+void npz_save(std::string const& zipname, std::string const& fname,
+              TConstInputIterator start,
+              cnpypp::span<uint64_t const> const shape,
+              std::string_view mode = "w",
+              MemoryOrder memory_order = MemoryOrder::C,
+              CompressionMethod compr_method = CompressionMethod::Deflate,
+              unsigned num_threads = 1) {
+  auto const parameters = detail::make_npz_source(start, shape, memory_order);
+  save_npz(zipname, fname, *parameters, shape, mode, compr_method,
+           num_threads);
+}
+#endif
+
+#ifndef NO_LIBZIP
+template <typename TTupleIterator>
+void npz_save(std::string const& zipname, std::string const& fname,
+              std::vector<std::string_view> const& labels, TTupleIterator first,
+              cnpypp::span<uint64_t const> const shape,
+              std::string_view mode = "w",
+              MemoryOrder memory_order = MemoryOrder::C,
+              CompressionMethod compr_method = CompressionMethod::Deflate,
+              unsigned num_threads = 1) {
+  auto const parameters =
+      detail::make_npz_source(labels, first, shape, memory_order);
+  save_npz(zipname, fname, *parameters, shape, mode, compr_method,
+           num_threads);
 }
 #endif
 
@@ -669,13 +1218,76 @@ void npz_save(std::string const& zipname, std::string fname,
               std::initializer_list<uint64_t const> shape,
               std::string_view mode = "w",
               MemoryOrder memory_order = MemoryOrder::C,
-              CompressionMethod compr_method = CompressionMethod::Deflate) {
+              CompressionMethod compr_method = CompressionMethod::Deflate,
+              unsigned num_threads = 1) {
   npz_save(zipname, std::move(fname), start,
            cnpypp::span<uint64_t const>{std::data(shape), shape.size()}, mode,
-           memory_order, compr_method);
+           memory_order, compr_method, num_threads);
 }
 #endif
 
+#ifndef NO_LIBZIP
+// writes any number of arrays into an NPZ archive that is opened only once.
+// the archive is written by close() in a single pass; the data of the arrays
+// are read from their iterators only then (except for arrays deflated
+// concurrently, i.e. with num_threads != 1, see npz_save()), so the iterators
+// have to stay valid until close()
+class NpzWriter {
+public:
+  explicit NpzWriter(std::string const& zipname, std::string_view mode = "w");
+  NpzWriter(NpzWriter const&) = delete;
+  NpzWriter(NpzWriter&&) = default;
+  NpzWriter& operator=(NpzWriter const&) = delete;
+  ~NpzWriter();
+
+  // parameters as in npz_save(); an array of the same name is replaced
+  template <typename TConstInputIterator>
+  void add(std::string fname, TConstInputIterator start,
+           cnpypp::span<uint64_t const> const shape,
+           MemoryOrder memory_order = MemoryOrder::C,
+           CompressionMethod compr_method = CompressionMethod::Deflate,
+           unsigned num_threads = 1) {
+    add_source(std::move(fname),
+               detail::make_npz_source(start, shape, memory_order),
+               compr_method, num_threads);
+  }
+
+  template <typename TConstInputIterator>
+  void add(std::string fname, TConstInputIterator start,
+           std::initializer_list<uint64_t const> shape,
+           MemoryOrder memory_order = MemoryOrder::C,
+           CompressionMethod compr_method = CompressionMethod::Deflate,
+           unsigned num_threads = 1) {
+    add(std::move(fname), start,
+        cnpypp::span<uint64_t const>{std::data(shape), shape.size()},
+        memory_order, compr_method, num_threads);
+  }
+
+  template <typename TTupleIterator>
+  void add(std::string fname, std::vector<std::string_view> const& labels,
+           TTupleIterator first, cnpypp::span<uint64_t const> const shape,
+           MemoryOrder memory_order = MemoryOrder::C,
+           CompressionMethod compr_method = CompressionMethod::Deflate,
+           unsigned num_threads = 1) {
+    add_source(std::move(fname),
+               detail::make_npz_source(labels, first, shape, memory_order),
+               compr_method, num_threads);
+  }
+
+  // writes the archive; called by the destructor if necessary
+  void close();
+
+private:
+  void add_source(std::string fname,
+                  std::unique_ptr<detail::additional_parameters> parameters,
+                  CompressionMethod compr_method, unsigned num_threads);
+
+  std::string zipname;
+  std::vector<std::unique_ptr<detail::additional_parameters>> sources;
+  std::unique_ptr<zip_t, void (*)(zip_t*)> archive;
+};
+#endif
+
 template <typename TForwardIterator>
 void npy_save(std::string const& fname, TForwardIterator first,
               TForwardIterator last, std::string_view mode = "w") {
@@ -705,7 +1317,9 @@ void npy_save(std::string const& fname,
               std::vector<std::string_view> const& labels, TTupleIterator first,
               cnpypp::span<uint64_t const> const shape,
               std::string_view mode = "w",
-              MemoryOrder memory_order = MemoryOrder::C) {
+              MemoryOrder memory_order = MemoryOrder::C,
+              size_t header_capacity = 0, size_t data_alignment = 16,
+              std::optional<PipelineOptions> const& pipeline = std::nullopt) {
   using value_type = typename std::iterator_traits<TTupleIterator>::value_type;
 
   if (labels.size() != std::tuple_size_v<value_type>) {
@@ -718,6 +1332,8 @@ void npy_save(std::string const& fname,
   std::fstream fs;
   std::vector<uint64_t>
       true_data_shape; // if appending, the shape of existing + new data
+  size_t header_size = 0; // if appending, size of the existing header
+  uint64_t payload_bytes = 0;
 
   if (mode == "a" && _exists(fname)) {
     // file exists. we need to append to it. read the header, modify the array
@@ -725,7 +1341,7 @@ void npy_save(std::string const& fname,
     fs.open(fname,
             std::ios_base::binary | std::ios_base::in | std::ios_base::out);
 
-    std::vector<unsigned> word_sizes_exist, shape;
+    std::vector<unsigned> word_sizes_exist;
     std::vector<char> data_types_exist;
     std::vector<std::string> labels_exist;
     cnpypp::MemoryOrder memory_order_exist;
@@ -733,6 +1349,10 @@ void npy_save(std::string const& fname,
     parse_npy_header(fs, word_sizes_exist, data_types_exist, labels_exist,
                      true_data_shape, memory_order_exist);
 
+    header_size = fs.tellg();
+    fs.seekg(0, std::ios_base::end);
+    payload_bytes = static_cast<uint64_t>(fs.tellg()) - header_size;
+
     if (tuple_info<value_type>::size != labels_exist.size()) {
       throw std::runtime_error{"libcnpy++ error in npy_save(): appending "
                                "failed: sizes not matching"};
@@ -779,18 +1399,27 @@ void npy_save(std::string const& fname,
     true_data_shape = std::vector<uint64_t>{shape.begin(), shape.end()};
   }
 
-  auto const header =
-      create_npy_header(shape, labels, dtypes, sizes, memory_order);
+  auto header = create_npy_header(true_data_shape, labels, dtypes, sizes,
+                                  memory_order, header_capacity,
+                                  data_alignment);
 
   uint64_t const nels = std::accumulate(shape.begin(), shape.end(), 1,
                                         std::multiplies<uint64_t>{});
 
-  fs.seekp(0, std::ios_base::beg);
-  fs.write(&header[0], sizeof(char) * header.size());
+  if (header_size > 0) {
+    // patch the existing header, moving the data only if necessary
+    update_npy_header(fs, std::move(header), header_size, payload_bytes);
+  } else {
+    fs.write(&header[0], sizeof(char) * header.size());
+  }
   fs.seekp(0, std::ios_base::end);
 
   // now write actual data
-  write_data_tuple(first, nels, fs);
+  if (pipeline) {
+    write_data_tuple_pipelined(first, nels, fs, *pipeline);
+  } else {
+    write_data_tuple(first, nels, fs);
+  }
 }
 
 template <typename TTupleIterator>
@@ -798,10 +1427,167 @@ void npy_save(std::string const& fname,
               std::vector<std::string_view> const& labels, TTupleIterator first,
               std::initializer_list<uint64_t const> shape,
               std::string_view mode = "w",
-              MemoryOrder memory_order = MemoryOrder::C) {
+              MemoryOrder memory_order = MemoryOrder::C,
+              size_t header_capacity = 0, size_t data_alignment = 16,
+              std::optional<PipelineOptions> const& pipeline = std::nullopt) {
   npy_save<TTupleIterator>(
       fname, labels, first,
       cnpypp::span<uint64_t const>{std::data(shape), shape.size()}, mode,
-      memory_order);
+      memory_order, header_capacity, data_alignment, pipeline);
 }
+
+// keeps an NPY file open for incremental appends along the leading axis
+// (trailing axis for Fortran order); data are buffered in memory and the
+// header is only rewritten on flush() or close()
+class NpyAppenderBase {
+public:
+  NpyAppenderBase(NpyAppenderBase const&) = delete;
+  NpyAppenderBase(NpyAppenderBase&&) = default;
+  NpyAppenderBase& operator=(NpyAppenderBase const&) = delete;
+  ~NpyAppenderBase();
+
+  // number of rows in file, including buffered rows
+  uint64_t rows() const {
+    return (payload_bytes + buffer_used) / row_bytes;
+  }
+
+  // writes buffered data and patches the header
+  void flush();
+
+  // flushes and closes the file; called by the destructor if necessary
+  void close();
+
+protected:
+  NpyAppenderBase(std::string const& fname,
+                  cnpypp::span<uint64_t const> row_shape,
+                  std::vector<std::string> labels, std::vector<char> dtypes,
+                  std::vector<size_t> sizes, std::string_view mode,
+                  MemoryOrder memory_order, size_t buffer_size,
+                  size_t header_capacity, size_t data_alignment);
+
+  void append_bytes(char const* data, size_t num_bytes);
+  void write_buffer();
+  std::vector<char> create_header() const;
+
+  std::fstream fs;
+  std::vector<uint64_t> const row_shape;
+  std::vector<std::string> const labels;
+  std::vector<char> const dtypes;
+  std::vector<size_t> const sizes;
+  MemoryOrder const memory_order;
+  uint64_t const row_elements;
+  uint64_t const row_bytes;
+  size_t const header_capacity;
+  size_t const data_alignment;
+
+  size_t header_size = 0;
+  uint64_t payload_bytes = 0; // bytes already written to file after header
+
+  size_t const buffer_capacity;
+  size_t buffer_used = 0;
+  std::unique_ptr<char[]> buffer;
+};
+
+template <typename T> class NpyAppender : public NpyAppenderBase {
+public:
+  // forbid implementations of std::bool with sizeof(bool) != 1
+  // numpy can't handle these
+  static_assert(sizeof(T) == 1 || !std::is_same_v<T, bool>,
+                "platforms with sizeof(bool) != 1 not supported");
+
+  NpyAppender(std::string const& fname,
+              cnpypp::span<uint64_t const> row_shape = {},
+              std::string_view mode = "w",
+              MemoryOrder memory_order = MemoryOrder::C,
+              size_t buffer_size = 0x100000, size_t header_capacity = 64,
+              size_t data_alignment = 16)
+      : NpyAppenderBase{fname,
+                        row_shape,
+                        {},
+                        {map_type(T{})},
+                        {sizeof(T)},
+                        mode,
+                        memory_order,
+                        std::max<size_t>(buffer_size, sizeof(T)),
+                        header_capacity,
+                        data_alignment} {}
+
+  // appends num_rows rows, i.e. num_rows * product(row_shape) elements
+  template <typename TConstInputIterator>
+  void append(TConstInputIterator first, uint64_t num_rows) {
+    using value_type =
+        typename std::iterator_traits<TConstInputIterator>::value_type;
+    uint64_t const nels = num_rows * row_elements;
+
+    if constexpr (is_contiguous_v<TConstInputIterator> &&
+                  std::is_same_v<std::remove_cv_t<value_type>, T>) {
+      append_bytes(reinterpret_cast<char const*>(&*first), nels * sizeof(T));
+    } else {
+      for (uint64_t i = 0; i < nels; ++i, ++first) {
+        if (buffer_capacity - buffer_used < sizeof(T)) {
+          write_buffer();
+        }
+        T const value = *first;
+        std::memcpy(&buffer[buffer_used], &value, sizeof(T));
+        buffer_used += sizeof(T);
+      }
+    }
+  }
+};
+
+template <typename TTuple> class NpyTupleAppender : public NpyAppenderBase {
+public:
+  // forbid implementations of std::bool with sizeof(bool) != 1
+  // numpy can't handle these
+  static_assert(sizeof(bool) == 1 || !tuple_info<TTuple>::has_bool_element,
+                "platforms with sizeof(bool) != 1 not supported");
+
+  NpyTupleAppender(std::string const& fname,
+                   std::vector<std::string_view> const& labels,
+                   cnpypp::span<uint64_t const> row_shape = {},
+                   std::string_view mode = "w",
+                   MemoryOrder memory_order = MemoryOrder::C,
+                   size_t buffer_size = 0x100000,
+                   size_t header_capacity = 64,
+                   size_t data_alignment = 16)
+      : NpyAppenderBase{
+            fname,
+            row_shape,
+            check_labels(labels),
+            {tuple_info<TTuple>::data_types.cbegin(),
+             tuple_info<TTuple>::data_types.cend()},
+            {tuple_info<TTuple>::element_sizes.cbegin(),
+             tuple_info<TTuple>::element_sizes.cend()},
+            mode,
+            memory_order,
+            std::max<size_t>(buffer_size, tuple_info<TTuple>::sum_sizes),
+            header_capacity,
+            data_alignment} {}
+
+  // appends num_rows rows of tuples, i.e. num_rows * product(row_shape)
+  // records
+  template <typename TTupleIterator>
+  void append(TTupleIterator first, uint64_t num_rows) {
+    auto constexpr sum_size = tuple_info<TTuple>::sum_sizes;
+    uint64_t const nels = num_rows * row_elements;
+
+    for (uint64_t i = 0; i < nels; ++i, ++first) {
+      if (buffer_capacity - buffer_used < sum_size) {
+        write_buffer();
+      }
+      fill<TTuple>(*first, &buffer[buffer_used]);
+      buffer_used += sum_size;
+    }
+  }
+
+private:
+  static std::vector<std::string>
+  check_labels(std::vector<std::string_view> const& labels) {
+    if (labels.size() != tuple_info<TTuple>::size) {
+      throw std::runtime_error(
+          "libcnpy++: number of labels does not match tuple size");
+    }
+    return {labels.cbegin(), labels.cend()};
+  }
+};
 } // namespace cnpypp
@@ -6,9 +6,15 @@
 #pragma once
 
 #include <cstddef>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/iostreams/device/mapped_file.hpp>
 
@@ -21,11 +27,24 @@ public:
   virtual ~Buffer() = default;
   virtual std::byte* data() = 0;
   virtual std::byte const* data() const = 0;
+
+  // writes back length bytes starting at data() + offset to the underlying
+  // storage, if any
+  virtual void flush(size_t /* offset */, size_t /* length */) {}
 };
 
+// memory is left uninitialized
 class InMemoryBuffer : public Buffer {
 public:
-  InMemoryBuffer(size_t size);
+  static size_t constexpr cache_line_size = 64;
+  static size_t constexpr huge_page_size = 0x200000;
+  static size_t page_size();
+
+  // alignment has to be a power of 2. with huge_pages, the buffer is aligned
+  // to (and padded to a multiple of) huge_page_size and, on Linux, marked
+  // for transparent huge pages via madvise(MADV_HUGEPAGE)
+  InMemoryBuffer(size_t size, size_t alignment = alignof(std::max_align_t),
+                 bool huge_pages = false);
   InMemoryBuffer(InMemoryBuffer const&) = delete;
   InMemoryBuffer(InMemoryBuffer&&) = default;
   ~InMemoryBuffer() = default;
@@ -34,12 +53,32 @@ public:
   virtual std::byte const* data() const override;
 
 private:
-  std::unique_ptr<std::byte[]> buffer;
+  struct aligned_delete {
+    size_t alignment;
+    void operator()(std::byte*) const;
+  };
+
+  std::unique_ptr<std::byte[], aligned_delete> buffer;
+};
+
+// controls how a file is memory-mapped. advice, huge_pages and populate are
+// hints to the OS and silently ignored where unsupported.
+struct MappingOptions {
+  enum class Advice { Normal, Sequential, Random, WillNeed };
+
+  // shared read-only mapping instead of a private copy-on-write one. the data
+  // can be read as usual, but writing to them crashes (SIGSEGV)
+  bool read_only = false;
+  Advice advice = Advice::Normal; // madvise()
+  bool huge_pages = false;        // MADV_HUGEPAGE (Linux only)
+  bool populate = false;          // prefault all pages, like MAP_POPULATE
+  bool lock = false; // mlock() the pages into RAM, throws if this fails
 };
 
 class MemoryMappedBuffer : public Buffer {
 public:
-  MemoryMappedBuffer(std::string const& path, size_t offset, size_t length);
+  MemoryMappedBuffer(std::string const& path, size_t offset, size_t length,
+                     MappingOptions const& options = MappingOptions{});
   MemoryMappedBuffer(MemoryMappedBuffer const&) = delete;
   MemoryMappedBuffer(MemoryMappedBuffer&&) = default;
   ~MemoryMappedBuffer() = default;
@@ -51,4 +90,82 @@ private:
   size_t const offset;
   boost::iostreams::mapped_file buffer;
 };
+
+// shared, writable mapping of a file: modifications of the data end up in
+// the file
+class WritableMappedBuffer : public Buffer {
+public:
+  WritableMappedBuffer(std::string const& path, size_t offset, size_t length);
+  WritableMappedBuffer(WritableMappedBuffer const&) = delete;
+  WritableMappedBuffer(WritableMappedBuffer&&) = default;
+  ~WritableMappedBuffer() = default;
+
+  virtual std::byte* data() override;
+  virtual std::byte const* data() const override;
+
+  // synchronously writes the given range to disk (msync())
+  virtual void flush(size_t offset, size_t length) override;
+
+private:
+  size_t const offset;
+  boost::iostreams::mapped_file buffer;
+};
+
+// refers to memory owned by someone else, e.g. the destination of
+// npy_load_into()
+class ExternalBuffer : public Buffer {
+public:
+  explicit ExternalBuffer(std::byte* data);
+
+  virtual std::byte* data() override;
+  virtual std::byte const* data() const override;
+
+private:
+  std::byte* const ptr;
+};
+
+// provides the buffer of size bytes and the given alignment into which an
+// array is loaded
+using BufferAllocator =
+    std::function<std::unique_ptr<Buffer>(size_t size, size_t alignment)>;
+
+// recycles InMemoryBuffers of power-of-2 size classes, so that repeatedly
+// loading arrays of similar size does not allocate memory for the payloads.
+// buffers may outlive the pool. thread-safe.
+class BufferPool {
+public:
+  // buffers returned to the pool beyond max_cached_bytes are freed
+  explicit BufferPool(
+      size_t max_cached_bytes = std::numeric_limits<size_t>::max());
+
+  std::unique_ptr<Buffer> allocate(size_t size, size_t alignment);
+
+  // returns a BufferAllocator for use with npy_load() / npz_load()
+  BufferAllocator allocator();
+
+  size_t hits() const;
+  size_t misses() const;
+  size_t cached_bytes() const;
+
+  // frees all cached buffers
+  void clear();
+
+private:
+  struct State {
+    explicit State(size_t max_cached_bytes_)
+        : max_cached_bytes{max_cached_bytes_} {}
+
+    std::mutex mutex;
+    // (size class, alignment) -> cached buffers
+    std::map<std::pair<size_t, size_t>,
+             std::vector<std::unique_ptr<InMemoryBuffer>>>
+        free_buffers;
+    size_t const max_cached_bytes;
+    size_t cached_bytes = 0, hits = 0, misses = 0;
+  };
+
+  class PooledBuffer;
+
+  std::shared_ptr<State> state;
+};
 } // namespace cnpypp
@@ -0,0 +1,304 @@
+// Copyright (C) 2023 Maximilian Reininghaus
+// Released under MIT License
+// license available in LICENSE file, or at
+// http://www.opensource.org/licenses/mit-license.php
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cnpypp {
+// count values of type T, stride bytes apart, e.g. a field of a structured
+// array (see NpyArray::column())
+template <typename T> struct column_view {
+  static_assert(std::is_arithmetic_v<T>, "only arithmetic types supported");
+
+  std::byte const* base;
+  std::ptrdiff_t stride;
+  uint64_t count;
+
+  T operator[](uint64_t i) const {
+    T value;
+    std::memcpy(&value, base + i * stride, sizeof(T));
+    return value;
+  }
+
+  column_view subview(uint64_t first, uint64_t n) const {
+    return column_view{base + first * stride, stride, n};
+  }
+};
+
+// type of sums over a column: double for floating-point values, 64 bit
+// integers otherwise
+template <typename T>
+using column_sum_t = std::conditional_t<
+    std::is_floating_point_v<T>, double,
+    std::conditional_t<std::is_signed_v<T>, int64_t, uint64_t>>;
+
+namespace detail {
+template <typename T> bool is_contiguous(column_view<T> const& col) {
+  return col.stride == sizeof(T) &&
+         reinterpret_cast<uintptr_t>(col.base) % alignof(T) == 0;
+}
+
+// calls f(value) for all values of the column. contiguous and aligned columns
+// are read through a plain pointer, otherwise with loads of constant stride
+template <typename T, typename F>
+void for_each_value(column_view<T> const& col, F&& f) {
+  if (is_contiguous(col)) {
+    T const* const ptr = reinterpret_cast<T const*>(col.base);
+    for (uint64_t i = 0; i < col.count; ++i) {
+      f(ptr[i]);
+    }
+  } else {
+    for (uint64_t i = 0; i < col.count; ++i) {
+      f(col[i]);
+    }
+  }
+}
+
+// sum of get(i) for i in [0, n). the compiler must not reorder floating-point
+// additions, so with a single accumulator every addition waits for the
+// previous one. four independent accumulators let them overlap
+template <typename T, typename Get>
+column_sum_t<T> sum_values(uint64_t n, Get const& get) {
+  using sum_type = column_sum_t<T>;
+  sum_type s0{0}, s1{0}, s2{0}, s3{0};
+  uint64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += get(i);
+    s1 += get(i + 1);
+    s2 += get(i + 2);
+    s3 += get(i + 3);
+  }
+  for (; i < n; ++i) {
+    s0 += get(i);
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+template <typename T> column_sum_t<T> sum_values(column_view<T> const& col) {
+  if (is_contiguous(col)) {
+    T const* const ptr = reinterpret_cast<T const*>(col.base);
+    return sum_values<T>(col.count, [ptr](uint64_t i) { return ptr[i]; });
+  } else {
+    return sum_values<T>(col.count, [&col](uint64_t i) { return col[i]; });
+  }
+}
+
+// splits the column into num_threads chunks of at least 64k values and
+// returns f(chunk, index of its first value) for every chunk, computed
+// concurrently. num_threads = 0 selects std::thread::hardware_concurrency()
+template <typename T, typename F>
+auto map_chunks(column_view<T> const& col, unsigned num_threads, F const& f) {
+  using result_type = decltype(f(col, uint64_t{}));
+
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  uint64_t const min_chunk = 0x10000;
+  auto const num_chunks = std::max<uint64_t>(
+      std::min<uint64_t>(num_threads, col.count / min_chunk), 1);
+  auto const chunk = (col.count + num_chunks - 1) / num_chunks;
+
+  std::vector<std::future<result_type>> futures;
+  for (uint64_t c = 1; c < num_chunks; ++c) {
+    auto const first = std::min(c * chunk, col.count);
+    auto const n = std::min(chunk, col.count - first);
+    futures.push_back(std::async(std::launch::async, [&f, &col, first, n]() {
+      return f(col.subview(first, n), first);
+    }));
+  }
+
+  std::vector<result_type> results;
+  results.push_back(f(col.subview(0, std::min(chunk, col.count)), 0));
+  for (auto& future : futures) {
+    results.push_back(future.get());
+  }
+  return results;
+}
+
+// first extreme value of a non-empty column according to comp and its index.
+// tracking the index defeats vectorization, so contiguous columns are
+// processed in blocks: the extreme value of a block is found with independent
+// accumulators the compiler turns into SIMD lanes, and its index is only
+// searched for if it beats the previous one
+template <typename T, typename Compare>
+std::pair<T, uint64_t> arg_extreme(column_view<T> const& col, Compare comp) {
+  T best = col[0];
+  uint64_t best_index = 0;
+
+  if (!is_contiguous(col)) {
+    for (uint64_t i = 1; i < col.count; ++i) {
+      if (T const value = col[i]; comp(value, best)) {
+        best = value;
+        best_index = i;
+      }
+    }
+    return {best, best_index};
+  }
+
+  T const* const ptr = reinterpret_cast<T const*>(col.base);
+  uint64_t constexpr block = 0x400, lanes = 64 / sizeof(T);
+  for (uint64_t first = 0; first < col.count; first += block) {
+    uint64_t const n = std::min(block, col.count - first);
+    T const* const values = ptr + first;
+
+    T lane_best[lanes];
+    std::fill_n(lane_best, lanes, best);
+    uint64_t i = 0;
+    for (; i + lanes <= n; i += lanes) {
+      for (uint64_t j = 0; j < lanes; ++j) {
+        lane_best[j] =
+            comp(values[i + j], lane_best[j]) ? values[i + j] : lane_best[j];
+      }
+    }
+    for (; i < n; ++i) {
+      lane_best[0] = comp(values[i], lane_best[0]) ? values[i] : lane_best[0];
+    }
+
+    T block_best = best;
+    for (auto const value : lane_best) {
+      block_best = comp(value, block_best) ? value : block_best;
+    }
+    if (comp(block_best, best)) { // never true for NaN
+      best = block_best;
+      best_index = first + (std::find(values, values + n, best) - values);
+    }
+  }
+  return {best, best_index};
+}
+
+// index of the first extreme value according to comp
+template <typename T, typename Compare>
+uint64_t column_arg_extreme(column_view<T> const& col, unsigned num_threads,
+                            Compare comp) {
+  if (col.count == 0) {
+    throw std::runtime_error("column kernel: empty column");
+  }
+
+  auto const partial = map_chunks(
+      col, num_threads, [comp](column_view<T> const& c, uint64_t first) {
+        auto const [best, best_index] = arg_extreme(c, comp);
+        return std::pair{best, first + best_index};
+      });
+
+  auto best = partial.front();
+  for (auto const& p : partial) {
+    if (comp(p.first, best.first)) {
+      best = p;
+    }
+  }
+  return best.second;
+}
+} // namespace detail
+
+template <typename T>
+column_sum_t<T> column_sum(column_view<T> const& col,
+                           unsigned num_threads = 1) {
+  auto const partial = detail::map_chunks(
+      col, num_threads,
+      [](column_view<T> const& c, uint64_t) { return detail::sum_values(c); });
+
+  column_sum_t<T> sum{0};
+  for (auto const s : partial) {
+    sum += s;
+  }
+  return sum;
+}
+
+// NaN for empty columns
+template <typename T>
+double column_mean(column_view<T> const& col, unsigned num_threads = 1) {
+  return col.count == 0 ? std::numeric_limits<double>::quiet_NaN()
+                        : static_cast<double>(column_sum(col, num_threads)) /
+                              col.count;
+}
+
+// pred is called concurrently if num_threads != 1
+template <typename T, typename Predicate>
+uint64_t column_count_if(column_view<T> const& col, Predicate pred,
+                         unsigned num_threads = 1) {
+  auto const partial = detail::map_chunks(
+      col, num_threads, [&pred](column_view<T> const& c, uint64_t) {
+        uint64_t n = 0;
+        detail::for_each_value(c, [&](T value) { n += pred(value) ? 1 : 0; });
+        return n;
+      });
+
+  uint64_t n = 0;
+  for (auto const p : partial) {
+    n += p;
+  }
+  return n;
+}
+
+// index of the first minimum; throws for empty columns
+template <typename T>
+uint64_t column_argmin(column_view<T> const& col, unsigned num_threads = 1) {
+  return detail::column_arg_extreme(col, num_threads, std::less<T>{});
+}
+
+// index of the first maximum; throws for empty columns
+template <typename T>
+uint64_t column_argmax(column_view<T> const& col, unsigned num_threads = 1) {
+  return detail::column_arg_extreme(col, num_threads, std::greater<T>{});
+}
+
+template <typename T>
+T column_min(column_view<T> const& col, unsigned num_threads = 1) {
+  return col[column_argmin(col, num_threads)];
+}
+
+template <typename T>
+T column_max(column_view<T> const& col, unsigned num_threads = 1) {
+  return col[column_argmax(col, num_threads)];
+}
+
+// writes the inclusive prefix sums of the column to out, which has to hold
+// col.count values. with several threads, the sums of the chunks are computed
+// first, then every chunk is scanned starting from the sum of its
+// predecessors
+template <typename T>
+void column_prefix_sum(column_view<T> const& col, column_sum_t<T>* out,
+                       unsigned num_threads = 1) {
+  using sum_type = column_sum_t<T>;
+
+  std::vector<sum_type> offsets{sum_type{0}};
+  if (num_threads != 1) {
+    auto const partial = detail::map_chunks(
+        col, num_threads, [](column_view<T> const& c, uint64_t) {
+          return detail::sum_values(c);
+        });
+    for (size_t i = 0; i + 1 < partial.size(); ++i) {
+      offsets.push_back(offsets.back() + partial[i]);
+    }
+  }
+
+  // same chunks as above
+  auto const num_chunks = offsets.size();
+  auto const chunk =
+      std::max<uint64_t>((col.count + num_chunks - 1) / num_chunks, 1);
+  auto const scan = [&](column_view<T> const& c, uint64_t first) {
+    sum_type sum = offsets[first / chunk];
+    sum_type* dest = out + first;
+    detail::for_each_value(c, [&](T value) {
+      sum += value;
+      *dest++ = sum;
+    });
+    return 0;
+  };
+  detail::map_chunks(col, static_cast<unsigned>(num_chunks), scan);
+}
+} // namespace cnpypp
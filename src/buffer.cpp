@@ -3,14 +3,52 @@
 // license available in LICENSE file, or at
 // http://www.opensource.org/licenses/mit-license.php
 
+#include <algorithm>
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
 
 #include <boost/iostreams/device/mapped_file.hpp>
 
 #include <cnpy++/buffer.hpp>
 
-cnpypp::InMemoryBuffer::InMemoryBuffer(size_t size)
-    : buffer{std::make_unique<std::byte[]>(size)} {}
+using mapmode = boost::iostreams::mapped_file::mapmode;
+
+static auto const alignment = boost::iostreams::mapped_file::alignment();
+
+size_t cnpypp::InMemoryBuffer::page_size() { return alignment; }
+
+cnpypp::InMemoryBuffer::InMemoryBuffer(size_t size, size_t alignment_,
+                                       bool huge_pages)
+    : buffer{nullptr, aligned_delete{huge_pages ? std::max(alignment_,
+                                                           huge_page_size)
+                                                : alignment_}} {
+  if (huge_pages) {
+    size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+  }
+
+  // no value-initialization: the buffer is overwritten anyway by the loader
+  buffer.reset(static_cast<std::byte*>(::operator new(
+      size, std::align_val_t{buffer.get_deleter().alignment})));
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (huge_pages && size > 0) {
+    madvise(buffer.get(), size, MADV_HUGEPAGE); // only a hint, may fail
+  }
+#endif
+}
+
+void cnpypp::InMemoryBuffer::aligned_delete::operator()(std::byte* ptr) const {
+  ::operator delete(ptr, std::align_val_t{alignment});
+}
 
 std::byte const* cnpypp::InMemoryBuffer::data() const { return buffer.get(); };
 
@@ -19,20 +57,210 @@ std::byte* cnpypp::InMemoryBuffer::data() {
       static_cast<InMemoryBuffer const&>(*this).data());
 }
 
-static auto const alignment = boost::iostreams::mapped_file::alignment();
+#if __has_include(<sys/mman.h>)
+static int advice_flag(cnpypp::MappingOptions::Advice advice) {
+  switch (advice) {
+  case cnpypp::MappingOptions::Advice::Sequential:
+    return MADV_SEQUENTIAL;
+  case cnpypp::MappingOptions::Advice::Random:
+    return MADV_RANDOM;
+  case cnpypp::MappingOptions::Advice::WillNeed:
+    return MADV_WILLNEED;
+  default:
+    return MADV_NORMAL;
+  }
+}
+
+// boost::iostreams::mapped_file provides no way to pass MAP_POPULATE
+static void prefault(char* addr, size_t size) {
+#if defined(MADV_POPULATE_READ)
+  if (madvise(addr, size, MADV_POPULATE_READ) == 0) {
+    return;
+  }
+#endif
+  // older kernels / other systems: touch every page
+  char sum = 0;
+  for (size_t i = 0; i < size; i += alignment) {
+    sum ^= static_cast<char volatile*>(addr)[i];
+  }
+  static_cast<void>(sum);
+}
+#endif
 
 cnpypp::MemoryMappedBuffer::MemoryMappedBuffer(std::string const& path,
-                                               size_t offset_, size_t length)
+                                               size_t offset_, size_t length,
+                                               MappingOptions const& options)
     : offset{offset_ % alignment},
-      buffer{path, boost::iostreams::mapped_file::mapmode::priv,
+      buffer{path, options.read_only ? mapmode::readonly : mapmode::priv,
              offset + length,
              static_cast<boost::iostreams::stream_offset>(
-                 (offset_ / alignment) * alignment)} {}
+                 (offset_ / alignment) * alignment)} {
+  char* const addr = const_cast<char*>(buffer.const_data());
+  size_t const size = buffer.size();
+
+  if (size == 0) {
+    return;
+  }
+
+#if __has_include(<sys/mman.h>)
+  // hints only, failures are ignored
+  if (options.advice != MappingOptions::Advice::Normal) {
+    madvise(addr, size, advice_flag(options.advice));
+  }
+#if defined(MADV_HUGEPAGE)
+  if (options.huge_pages) {
+    madvise(addr, size, MADV_HUGEPAGE);
+  }
+#endif
+  if (options.populate) {
+    prefault(addr, size);
+  }
+  if (options.lock && mlock(addr, size) != 0) {
+    throw std::runtime_error{
+        std::string{"MemoryMappedBuffer: mlock() failed: "} +
+        std::strerror(errno)};
+  }
+#else
+  if (options.lock) {
+    throw std::runtime_error{
+        "MemoryMappedBuffer: mlock() not supported on this platform"};
+  }
+#endif
+}
 
 std::byte const* cnpypp::MemoryMappedBuffer::data() const {
-  return reinterpret_cast<std::byte const*>(buffer.data() + offset);
+  return reinterpret_cast<std::byte const*>(buffer.const_data() + offset);
 }
 
 std::byte* cnpypp::MemoryMappedBuffer::data() {
+  return const_cast<std::byte*>(
+      static_cast<MemoryMappedBuffer const&>(*this).data());
+}
+
+cnpypp::WritableMappedBuffer::WritableMappedBuffer(std::string const& path,
+                                                   size_t offset_,
+                                                   size_t length)
+    : offset{offset_ % alignment},
+      buffer{path, mapmode::readwrite, offset + length,
+             static_cast<boost::iostreams::stream_offset>(
+                 (offset_ / alignment) * alignment)} {}
+
+std::byte const* cnpypp::WritableMappedBuffer::data() const {
+  return reinterpret_cast<std::byte const*>(buffer.data() + offset);
+}
+
+std::byte* cnpypp::WritableMappedBuffer::data() {
   return reinterpret_cast<std::byte*>(buffer.data() + offset);
 }
+
+void cnpypp::WritableMappedBuffer::flush(size_t offset_, size_t length) {
+  if (length == 0) {
+    return;
+  }
+
+  // the range has to start at a page boundary
+  size_t const begin = (offset + offset_) / alignment * alignment;
+  size_t const end = offset + offset_ + length;
+
+#if __has_include(<sys/mman.h>)
+  if (msync(buffer.data() + begin, end - begin, MS_SYNC) != 0) {
+    throw std::runtime_error{
+        std::string{"WritableMappedBuffer: msync() failed: "} +
+        std::strerror(errno)};
+  }
+#elif defined(_WIN32)
+  if (!FlushViewOfFile(buffer.data() + begin, end - begin)) {
+    throw std::runtime_error{"WritableMappedBuffer: FlushViewOfFile() failed"};
+  }
+#endif
+}
+
+cnpypp::ExternalBuffer::ExternalBuffer(std::byte* data) : ptr{data} {}
+
+std::byte const* cnpypp::ExternalBuffer::data() const { return ptr; }
+
+std::byte* cnpypp::ExternalBuffer::data() { return ptr; }
+
+class cnpypp::BufferPool::PooledBuffer : public Buffer {
+public:
+  PooledBuffer(std::shared_ptr<State> state_, std::pair<size_t, size_t> key_,
+               std::unique_ptr<InMemoryBuffer> buffer_)
+      : state{std::move(state_)}, key{key_}, buffer{std::move(buffer_)} {}
+
+  ~PooledBuffer() {
+    std::lock_guard<std::mutex> const lock{state->mutex};
+    if (state->cached_bytes + key.first <= state->max_cached_bytes) {
+      state->free_buffers[key].push_back(std::move(buffer));
+      state->cached_bytes += key.first;
+    }
+  }
+
+  virtual std::byte* data() override { return buffer->data(); }
+  virtual std::byte const* data() const override { return buffer->data(); }
+
+private:
+  std::shared_ptr<State> const state;
+  std::pair<size_t, size_t> const key;
+  std::unique_ptr<InMemoryBuffer> buffer;
+};
+
+cnpypp::BufferPool::BufferPool(size_t max_cached_bytes)
+    : state{std::make_shared<State>(max_cached_bytes)} {}
+
+std::unique_ptr<cnpypp::Buffer> cnpypp::BufferPool::allocate(size_t size,
+                                                             size_t alignment) {
+  size_t size_class = 0x1000;
+  while (size_class < size) {
+    size_class *= 2;
+  }
+
+  std::pair<size_t, size_t> const key{
+      size_class, std::max(alignment, alignof(std::max_align_t))};
+  std::unique_ptr<InMemoryBuffer> buffer;
+
+  {
+    std::lock_guard<std::mutex> const lock{state->mutex};
+    if (auto it = state->free_buffers.find(key);
+        it != state->free_buffers.end() && !it->second.empty()) {
+      buffer = std::move(it->second.back());
+      it->second.pop_back();
+      state->cached_bytes -= size_class;
+      ++state->hits;
+    } else {
+      ++state->misses;
+    }
+  }
+
+  if (!buffer) {
+    buffer = std::make_unique<InMemoryBuffer>(size_class, key.second);
+  }
+
+  return std::make_unique<PooledBuffer>(state, key, std::move(buffer));
+}
+
+cnpypp::BufferAllocator cnpypp::BufferPool::allocator() {
+  return [pool = *this](size_t size, size_t alignment) mutable {
+    return pool.allocate(size, alignment);
+  };
+}
+
+size_t cnpypp::BufferPool::hits() const {
+  std::lock_guard<std::mutex> const lock{state->mutex};
+  return state->hits;
+}
+
+size_t cnpypp::BufferPool::misses() const {
+  std::lock_guard<std::mutex> const lock{state->mutex};
+  return state->misses;
+}
+
+size_t cnpypp::BufferPool::cached_bytes() const {
+  std::lock_guard<std::mutex> const lock{state->mutex};
+  return state->cached_bytes;
+}
+
+void cnpypp::BufferPool::clear() {
+  std::lock_guard<std::mutex> const lock{state->mutex};
+  state->free_buffers.clear();
+  state->cached_bytes = 0;
+}
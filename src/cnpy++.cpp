@@ -4,15 +4,34 @@
 // http://www.opensource.org/licenses/mit-license.php
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <climits>
 #include <complex>
+#include <condition_variable>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
-#include <regex>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <stdint.h>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <boost/endian/conversion.hpp>
 #include <boost/filesystem.hpp>
@@ -20,6 +39,7 @@
 
 #ifndef NO_LIBZIP
 #include <zip.h>
+#include <zlib.h>
 #endif
 
 #include "cnpy++.hpp"
@@ -46,9 +66,68 @@ bool cnpypp::_exists(std::string const& fname) {
   return boost::filesystem::exists(fname);
 }
 
-static std::regex const num_regex("[0-9][0-9]*");
-static std::regex const
-    dtype_tuple_regex("\\('(\\w+)', '([<>|])([a-zA-z])(\\d+)'\\)");
+static std::unique_ptr<Buffer>
+allocate_buffer(cnpypp::BufferAllocator const& allocator, size_t size,
+                size_t alignment = alignof(std::max_align_t)) {
+  if (allocator) {
+    return allocator(size, alignment);
+  } else {
+    return std::make_unique<InMemoryBuffer>(size, alignment);
+  }
+}
+
+// allocator handing out dest, after checking that the payload fits
+static cnpypp::BufferAllocator into_span(cnpypp::span<std::byte> dest,
+                                         char const* caller) {
+  return [dest, caller](size_t size, size_t) -> std::unique_ptr<Buffer> {
+    if (size > dest.size()) {
+      std::stringstream ss;
+      ss << caller << ": destination too small (" << dest.size()
+         << " bytes, payload has " << size << " bytes)";
+      throw std::runtime_error{ss.str()};
+    }
+    return std::make_unique<cnpypp::ExternalBuffer>(dest.data());
+  };
+}
+
+static std::string_view const npy_magic_string = "\x93NUMPY";
+
+// size of the fixed part of the header (magic string, version, length of the
+// dict) for a given major version of the NPY format
+static size_t npy_preamble_size(uint8_t major_version) {
+  switch (major_version) {
+  case 1:
+    return 10;
+  case 2:
+  case 3: // same layout as 2.0, but with UTF-8 encoded dict
+    return 12;
+  default:
+    throw std::runtime_error(
+        "parse_npy_header: NPY format version not supported");
+  }
+}
+
+// reads the length of the dict from the preamble
+static uint32_t npy_dict_length(char const* preamble) {
+  if (npy_preamble_size(preamble[6]) == 10) {
+    return boost::endian::endian_load<boost::uint16_t, 2,
+                                      boost::endian::order::little>(
+        reinterpret_cast<unsigned char const*>(preamble + 8));
+  } else {
+    return boost::endian::endian_load<boost::uint32_t, 4,
+                                      boost::endian::order::little>(
+        reinterpret_cast<unsigned char const*>(preamble + 8));
+  }
+}
+
+size_t cnpypp::npy_header_size(std::istream::char_type const* preamble) {
+  if (!std::equal(npy_magic_string.begin(), npy_magic_string.end(),
+                  preamble)) {
+    throw std::runtime_error("parse_npy_header: NPY magic string not found");
+  }
+
+  return npy_preamble_size(preamble[6]) + npy_dict_length(preamble);
+}
 
 void cnpypp::parse_npy_header(std::istream::char_type const* buffer,
                               std::vector<unsigned>& word_sizes,
@@ -56,185 +135,288 @@ void cnpypp::parse_npy_header(std::istream::char_type const* buffer,
                               std::vector<std::string>& labels,
                               std::vector<uint64_t>& shape,
                               cnpypp::MemoryOrder& memory_order) {
-  uint8_t const major_version = *reinterpret_cast<uint8_t const*>(buffer + 6);
-  uint8_t const minor_version = *reinterpret_cast<uint8_t const*>(buffer + 7);
-  uint16_t const header_len =
-      boost::endian::endian_load<boost::uint16_t, 2,
-                                 boost::endian::order::little>(
-          (unsigned char const*)buffer + 8);
-  cnpypp::span<char const> header(reinterpret_cast<char const*>(buffer + 0x0a),
-                                  header_len);
-
-  if (!(major_version == 1 && minor_version == 0)) {
-    throw std::runtime_error("parse_npy_header: version not supported");
-  }
+  auto const preamble_size = npy_preamble_size(buffer[6]);
+  auto const header_len = npy_dict_length(buffer);
+  cnpypp::span<char const> header(
+      reinterpret_cast<char const*>(buffer + preamble_size), header_len);
 
   parse_npy_dict(header, word_sizes, data_types, labels, shape, memory_order);
 }
 
-static std::string_view const npy_magic_string = "\x93NUMPY";
-
 void cnpypp::parse_npy_header(std::istream& fs,
                               std::vector<unsigned>& word_sizes,
                               std::vector<char>& data_types,
                               std::vector<std::string>& labels,
                               std::vector<uint64_t>& shape,
                               cnpypp::MemoryOrder& memory_order) {
-  std::array<std::istream::char_type, 10> buffer;
-  fs.read(buffer.data(), 10);
+  std::array<std::istream::char_type, 12> buffer;
+  fs.read(buffer.data(), 8);
 
-  if (!std::equal(npy_magic_string.begin(), npy_magic_string.end(),
-                  buffer.cbegin())) {
+  if (!fs || !std::equal(npy_magic_string.begin(), npy_magic_string.end(),
+                         buffer.cbegin())) {
     throw std::runtime_error("parse_npy_header: NPY magic string not found");
   }
 
-  uint8_t const major_version = buffer[6];
-  uint8_t const minor_version = buffer[7];
-
-  if (major_version != 1 || minor_version != 0) {
-    throw std::runtime_error(
-        "parse_npy_header: NPY format version not supported");
-  }
+  auto const preamble_size = npy_preamble_size(buffer[6]);
+  fs.read(buffer.data() + 8, preamble_size - 8);
 
-  uint16_t const header_len =
-      boost::endian::endian_load<boost::uint16_t, 2,
-                                 boost::endian::order::little>(
-          reinterpret_cast<unsigned char*>(&buffer[8]));
+  auto const header_len = npy_dict_length(buffer.data());
 
   auto const header_buffer =
       std::make_unique<std::istream::char_type[]>(header_len);
   fs.read(header_buffer.get(), header_len);
 
+  if (!fs) {
+    throw std::runtime_error("parse_npy_header: header truncated");
+  }
+
   parse_npy_dict(
       cnpypp::span<std::istream::char_type>(header_buffer.get(), header_len),
       word_sizes, data_types, labels, shape, memory_order);
 }
 
+namespace {
+// minimal single-pass tokenizer for the Python dict literal in NPY headers
+class dict_tokenizer {
+public:
+  explicit dict_tokenizer(std::string_view dict) : dict_{dict} {}
+
+  // skips whitespace and consumes c if it is the next character
+  bool consume(char c) {
+    skip_whitespace();
+    if (pos_ < dict_.size() && dict_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c) {
+    if (!consume(c)) {
+      throw std::runtime_error("invalid header: malformed dictionary");
+    }
+  }
+
+  // parses a single- or double-quoted string literal (without escapes)
+  std::string_view string_literal() {
+    skip_whitespace();
+    if (pos_ >= dict_.size() || (dict_[pos_] != '\'' && dict_[pos_] != '"')) {
+      throw std::runtime_error("invalid header: string literal expected");
+    }
+
+    char const quote = dict_[pos_++];
+    auto const end = dict_.find(quote, pos_);
+    if (end == std::string_view::npos) {
+      throw std::runtime_error("invalid header: unterminated string literal");
+    }
+
+    auto const str = dict_.substr(pos_, end - pos_);
+    pos_ = end + 1;
+    return str;
+  }
+
+  uint64_t integer() {
+    skip_whitespace();
+    auto const start = pos_;
+    uint64_t value = 0;
+
+    for (; pos_ < dict_.size() && dict_[pos_] >= '0' && dict_[pos_] <= '9';
+         ++pos_) {
+      uint64_t const digit = dict_[pos_] - '0';
+      if (value > (UINT64_MAX - digit) / 10) {
+        throw std::runtime_error("invalid header: integer out of range");
+      }
+      value = value * 10 + digit;
+    }
+
+    if (pos_ == start) {
+      throw std::runtime_error("invalid header: integer expected");
+    }
+
+    return value;
+  }
+
+  bool boolean() {
+    skip_whitespace();
+    auto const rest = dict_.substr(pos_);
+    if (rest.substr(0, 4) == "True") {
+      pos_ += 4;
+      return true;
+    } else if (rest.substr(0, 5) == "False") {
+      pos_ += 5;
+      return false;
+    } else {
+      throw std::runtime_error("invalid header: boolean expected");
+    }
+  }
+
+  char peek() {
+    skip_whitespace();
+    return (pos_ < dict_.size()) ? dict_[pos_] : '\0';
+  }
+
+private:
+  void skip_whitespace() {
+    while (pos_ < dict_.size() &&
+           (dict_[pos_] == ' ' || dict_[pos_] == '\t' || dict_[pos_] == '\n' ||
+            dict_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  std::string_view const dict_;
+  size_t pos_ = 0;
+};
+
+// parses a simple type descriptor such as "<f8" or "|u1"
+void parse_type_descriptor(std::string_view descr,
+                           std::vector<char>& data_types,
+                           std::vector<unsigned>& word_sizes) {
+  if (descr.size() < 3 ||
+      (descr[0] != '<' && descr[0] != '>' && descr[0] != '|' &&
+       descr[0] != '=') ||
+      !std::isalpha(static_cast<unsigned char>(descr[1]))) {
+    throw std::runtime_error(
+        "parse_npy_header: could not parse data type descriptor");
+  } else if (descr[0] == '>') {
+    throw std::runtime_error("parse_npy_header: data stored in big-endian "
+                             "format (not supported)");
+  }
+
+  unsigned size = 0;
+  for (auto const c : descr.substr(2)) {
+    if (c < '0' || c > '9' || size > (UINT_MAX - 9) / 10) {
+      throw std::runtime_error(
+          "parse_npy_header: could not parse data type descriptor");
+    }
+    size = size * 10 + (c - '0');
+  }
+
+  data_types.push_back(descr[1]);
+  word_sizes.push_back(size);
+}
+} // namespace
+
 void cnpypp::parse_npy_dict(cnpypp::span<std::istream::char_type const> buffer,
                             std::vector<unsigned>& word_sizes,
                             std::vector<char>& data_types,
                             std::vector<std::string>& labels,
                             std::vector<uint64_t>& shape,
                             cnpypp::MemoryOrder& memory_order) {
-  if (buffer.back() != '\n') {
+  if (buffer.empty() || buffer.back() != '\n') {
     throw std::runtime_error("invalid header: missing terminating newline");
   } else if (buffer.front() != '{') {
     throw std::runtime_error("invalid header: malformed dictionary");
   }
 
-  std::string_view const dict{buffer.data(), buffer.size()};
-
-  if (std::cmatch matches;
-      !std::regex_search(dict.begin(), dict.end(), matches,
-                         std::regex{"'fortran_order': (True|False)"})) {
-    throw std::runtime_error("invalid header: missing 'fortran_order'");
-  } else {
-    memory_order = (matches[1].str() == "True") ? cnpypp::MemoryOrder::Fortran
-                                                : cnpypp::MemoryOrder::C;
-  }
-
   word_sizes.clear();
   data_types.clear();
   labels.clear();
   shape.clear();
 
-  // read & fill shape
-
-  std::string_view const sh = "'shape': (";
-
-  if (auto const pos_start_shape = dict.find(sh);
-      pos_start_shape == std::string_view::npos) {
-    throw std::runtime_error("invalid header: missing 'shape'");
-  } else {
-    if (auto const pos_end_shape = dict.find(')', pos_start_shape);
-        pos_end_shape == std::string_view::npos) {
-      throw std::runtime_error("invalid header: malformed dictionary");
-    } else {
-      std::regex digit_re{"\\d+"};
-      auto dims_begin =
-          std::cregex_iterator(dict.begin() + pos_start_shape,
-                               dict.begin() + pos_end_shape, digit_re);
-      auto dims_end = std::cregex_iterator();
-
-      for (std::cregex_iterator it = dims_begin; it != dims_end; ++it) {
-        shape.push_back(std::stoi(it->str()));
-      }
-    }
-  }
+  dict_tokenizer tok{std::string_view{buffer.data(), buffer.size()}};
+  bool has_descr = false, has_fortran_order = false, has_shape = false;
+
+  tok.expect('{');
+  while (!tok.consume('}')) {
+    auto const key = tok.string_literal();
+    tok.expect(':');
+
+    if (key == "descr") {
+      if (auto const c = tok.peek(); c == '\'' || c == '"') {
+        // simple type
+        parse_type_descriptor(tok.string_literal(), data_types, word_sizes);
+      } else if (c == '[') {
+        // structured type / tuple
+        tok.expect('[');
+        while (!tok.consume(']')) {
+          tok.expect('(');
+          labels.emplace_back(tok.string_literal());
+          tok.expect(',');
+          parse_type_descriptor(tok.string_literal(), data_types, word_sizes);
+          tok.consume(',');
+          if (!tok.consume(')')) {
+            throw std::runtime_error("parse_npy_header: sub-array or nested "
+                                     "data types not supported");
+          }
 
-  std::string_view const desc = "'descr': ";
-  if (auto const pos_start_desc = dict.find(desc);
-      pos_start_desc == std::string_view::npos) {
-    throw std::runtime_error("invalid header: missing 'descr'");
-  } else {
-    if (auto const c = dict[pos_start_desc + desc.size()]; c == '\'') {
-      // simple type
-
-      if (std::cmatch matches;
-          !std::regex_search(dict.begin() + pos_start_desc, dict.end(), matches,
-                             std::regex{"'([<>\\|])([a-zA-z])(\\d+)'"})) {
-        throw std::runtime_error(
-            "parse_npy_header: could not parse data type descriptor");
-      } else if (matches[1].str() == ">") {
-        throw std::runtime_error("parse_npy_header: data stored in big-endian "
-                                 "format (not supported)");
+          if (!tok.consume(',')) {
+            tok.expect(']');
+            break;
+          }
+        }
       } else {
-        data_types.push_back(*(matches[2].first));
-        word_sizes.push_back(std::stoi(matches[3].str()));
+        throw std::runtime_error("invalid header: malformed 'descr'");
       }
-    } else if (c == '[') {
-      // structured type / tuple
-
-      if (auto const pos_end_list =
-              dict.find(']', pos_start_desc + desc.size());
-          pos_end_list == std::string_view::npos) {
-        throw std::runtime_error("invalid header: malformed list in 'descr'");
-      } else {
-        auto tuples_begin = std::cregex_iterator(
-            dict.begin() + pos_start_desc + desc.size(),
-            dict.begin() + pos_end_list, dtype_tuple_regex);
-        auto tuples_end = std::cregex_iterator();
-
-        for (std::cregex_iterator it = tuples_begin; it != tuples_end; ++it) {
-          auto&& match = *it;
-          labels.emplace_back(match[1].str());
-
-          if (match[2].str() == ">") {
-            throw std::runtime_error("parse_npy_header: data stored in "
-                                     "big-endian format (not supported)");
-          }
-
-          data_types.push_back(*(match[3].first));
-          word_sizes.push_back(std::stoi(match[4].str()));
+      has_descr = true;
+    } else if (key == "fortran_order") {
+      memory_order = tok.boolean() ? cnpypp::MemoryOrder::Fortran
+                                   : cnpypp::MemoryOrder::C;
+      has_fortran_order = true;
+    } else if (key == "shape") {
+      tok.expect('(');
+      while (!tok.consume(')')) {
+        shape.push_back(tok.integer());
+
+        if (!tok.consume(',')) {
+          tok.expect(')');
+          break;
         }
       }
+      has_shape = true;
     } else {
-      throw std::runtime_error("invalid header: malformed 'descr'");
+      throw std::runtime_error("invalid header: unexpected key in dictionary");
+    }
+
+    if (!tok.consume(',')) {
+      tok.expect('}');
+      break;
     }
   }
+
+  if (!has_descr) {
+    throw std::runtime_error("invalid header: missing 'descr'");
+  } else if (!has_fortran_order) {
+    throw std::runtime_error("invalid header: missing 'fortran_order'");
+  } else if (!has_shape) {
+    throw std::runtime_error("invalid header: missing 'shape'");
+  }
 }
 
 #ifndef NO_LIBZIP
-cnpypp::NpyArray load_npy(zip_t* archive, zip_int64_t index) {
-  zip_stat_t fileinfo;
-  zip_stat_index(archive, index, ZIP_FL_ENC_RAW, &fileinfo);
-  if (!(fileinfo.valid & ZIP_STAT_SIZE)) {
-    throw std::runtime_error{"libcnpy++: zip_stat() failed, size invalid"};
-  }
-  if (!(fileinfo.valid & ZIP_STAT_COMP_METHOD)) {
-    throw std::runtime_error{
-        "libcnpy++: zip_stat() failed, comp_method invalid"};
+// reads exactly the header from the beginning of an NPY file in an archive,
+// so that the following reads return the payload
+static std::vector<char> read_npy_header(zip_file_t* file) {
+  size_t const preamble_size = 12; // version 2.0 and above, 10 for 1.0
+  std::vector<char> header(preamble_size);
+
+  auto read_bytes = zip_fread(file, header.data(), preamble_size);
+  if (read_bytes == static_cast<zip_int64_t>(preamble_size)) {
+    auto const header_size = npy_header_size(header.data());
+    if (header_size > preamble_size) {
+      header.resize(header_size);
+      auto const rest = zip_fread(file, header.data() + preamble_size,
+                                  header_size - preamble_size);
+      read_bytes = rest == -1 ? -1 : read_bytes + rest;
+    }
   }
 
-  zip_file_t* file = zip_fopen_index(archive, index, ZIP_FL_ENC_RAW);
-
-  size_t const max_header_size = 0x10000 + 10; // for npy version 1
-  auto header_buffer = std::make_unique<char[]>(max_header_size);
-
-  auto const read_bytes = zip_fread(file, header_buffer.get(), max_header_size);
   if (read_bytes == -1) {
-    zip_fclose(file);
     throw std::runtime_error{"libcnpy++: zip_fread() failed"};
+  } else if (read_bytes < static_cast<zip_int64_t>(preamble_size) ||
+             static_cast<size_t>(read_bytes) != header.size()) {
+    throw std::runtime_error{"parse_npy_header: header truncated"};
+  }
+  return header;
+}
+
+// decompresses the array in a single pass: the header is read first, the
+// payload goes directly into the buffer
+static cnpypp::NpyArray load_npy(zip_t* archive, zip_int64_t index,
+                                 cnpypp::BufferAllocator const& allocator) {
+  zip_file_t* const file = zip_fopen_index(archive, index, ZIP_FL_ENC_RAW);
+  if (!file) {
+    throw std::runtime_error{"libcnpy++: zip_fopen_index() failed"};
   }
 
   std::vector<uint64_t> shape;
@@ -242,52 +424,28 @@ cnpypp::NpyArray load_npy(zip_t* archive, zip_int64_t index) {
   std::vector<char> data_types; // filled but not used
   std::vector<std::string> labels;
   MemoryOrder memory_order;
-  parse_npy_header(header_buffer.get(), word_sizes, data_types, labels, shape,
-                   memory_order);
+  std::unique_ptr<Buffer> buffer;
 
-  auto const num_vals = std::accumulate(shape.begin(), shape.end(), uint64_t{1},
-                                        std::multiplies<uint64_t>{});
-  auto const total_value_size = std::accumulate(
-      word_sizes.begin(), word_sizes.end(), 0u, std::plus<unsigned>());
-  auto const num_bytes = total_value_size * num_vals;
+  try {
+    auto const header = read_npy_header(file);
+    parse_npy_header(header.data(), word_sizes, data_types, labels, shape,
+                     memory_order);
 
-  auto buffer = std::make_unique<InMemoryBuffer>(num_bytes);
-
-  zip_int64_t const offset = fileinfo.size - num_bytes;
-  if (fileinfo.size <= max_header_size) {
-    // file fits completely into buffer, meaning we have
-    // read it completely already
-
-    std::copy_n(&header_buffer[offset], num_bytes,
-                reinterpret_cast<char*>(buffer->data()));
-  } else { // we have only parts, seek back to beginning of data and read all
-           // from there
-    // works only if zip_source is seekable itself
-    // change this to zip_file_is_seekable() when libzip 1.9.0 is in use
-    // everywhere
-    if (fileinfo.comp_method == ZIP_CM_STORE) {
-      if (zip_fseek(file, offset, SEEK_SET) != 0) {
-        zip_fclose(file);
-        throw std::runtime_error{"libcnpy++: zip_seek() failed"};
-      }
-    } else { // compressed data, seek impossible
-      // reopen file
-      zip_fclose(file);
-
-      file = zip_fopen_index(archive, index, ZIP_FL_ENC_RAW);
-      auto tmp = std::make_unique<char[]>(offset);
-      if (zip_fread(file, tmp.get(), offset) != offset) {
-        zip_fclose(file);
-        throw std::runtime_error{"libcnpy++: zip_fread() failed"};
-      }
-    }
+    auto const num_vals = std::accumulate(
+        shape.begin(), shape.end(), uint64_t{1}, std::multiplies<uint64_t>{});
+    auto const total_value_size = std::accumulate(
+        word_sizes.begin(), word_sizes.end(), 0u, std::plus<unsigned>());
+    auto const num_bytes = total_value_size * num_vals;
+
+    buffer = allocate_buffer(allocator, num_bytes);
 
-    // now read data
     if (zip_fread(file, buffer->data(), num_bytes) !=
         static_cast<zip_int64_t>(num_bytes)) {
-      zip_fclose(file);
       throw std::runtime_error{"libcnpy++: zip_fread() failed"};
     }
+  } catch (...) {
+    zip_fclose(file);
+    throw;
   }
 
   zip_fclose(file);
@@ -297,7 +455,184 @@ cnpypp::NpyArray load_npy(zip_t* archive, zip_int64_t index) {
 #endif
 
 #ifndef NO_LIBZIP
-cnpypp::npz_t cnpypp::npz_load(std::string const& fname) {
+template <typename T> static T load_le(char const* ptr) {
+  return boost::endian::endian_load<T, sizeof(T), boost::endian::order::little>(
+      reinterpret_cast<unsigned char const*>(ptr));
+}
+
+template <typename T> static void store_le(char* ptr, T value) {
+  boost::endian::endian_store<T, sizeof(T), boost::endian::order::little>(
+      reinterpret_cast<unsigned char*>(ptr), value);
+}
+
+template <typename T> static void append_le(std::vector<char>& vec, T value) {
+  vec.resize(vec.size() + sizeof(T));
+  store_le<T>(&vec[vec.size() - sizeof(T)], value);
+}
+
+namespace {
+struct CentralDirectory {
+  uint64_t offset, num_entries;
+  std::vector<char> records; // central file headers of all entries
+  std::string comment;       // of the archive
+};
+} // namespace
+
+static CentralDirectory read_central_directory(std::istream& fs) {
+  fs.seekg(0, std::ios::end);
+  uint64_t const file_size = fs.tellg();
+
+  // end of central directory record, followed by a comment of up to 64 KiB
+  size_t const eocd_size = 22;
+  auto const tail_size = std::min<uint64_t>(file_size, eocd_size + 0xffff);
+  std::vector<char> tail(tail_size);
+  fs.seekg(file_size - tail_size);
+  fs.read(tail.data(), tail_size);
+
+  char const* eocd = nullptr;
+  for (auto pos = tail.size(); pos >= eocd_size && !eocd; --pos) {
+    if (load_le<uint32_t>(&tail[pos - eocd_size]) == 0x06054b50) {
+      eocd = &tail[pos - eocd_size];
+    }
+  }
+  if (!fs || !eocd) {
+    throw std::runtime_error{"libcnpy++: zip central directory not found"};
+  }
+
+  uint64_t num_entries = load_le<uint16_t>(eocd + 10);
+  uint64_t dir_size = load_le<uint32_t>(eocd + 12);
+  uint64_t dir_offset = load_le<uint32_t>(eocd + 16);
+
+  // zip64 end of central directory locator
+  auto const eocd_offset = file_size - tail_size + (eocd - tail.data());
+  if (eocd_offset >= 20 && load_le<uint32_t>(eocd - 20) == 0x07064b50) {
+    char record[56];
+    fs.seekg(load_le<uint64_t>(eocd - 12));
+    fs.read(record, sizeof(record));
+    if (!fs || load_le<uint32_t>(record) != 0x06064b50) {
+      throw std::runtime_error{"libcnpy++: zip64 central directory not found"};
+    }
+    num_entries = load_le<uint64_t>(record + 32);
+    dir_size = load_le<uint64_t>(record + 40);
+    dir_offset = load_le<uint64_t>(record + 48);
+  }
+
+  auto const comment_length =
+      std::min<uint64_t>(load_le<uint16_t>(eocd + 20),
+                         tail.data() + tail.size() - (eocd + eocd_size));
+
+  CentralDirectory directory{
+      dir_offset, num_entries, std::vector<char>(dir_size),
+      std::string{eocd + eocd_size, static_cast<size_t>(comment_length)}};
+  fs.seekg(dir_offset);
+  fs.read(directory.records.data(), dir_size);
+  if (!fs) {
+    throw std::runtime_error{"libcnpy++: zip central directory truncated"};
+  }
+
+  return directory;
+}
+
+// returns the offsets of the local headers of the entries by name. libzip
+// does not expose these.
+static std::map<std::string, uint64_t>
+zip_local_header_offsets(CentralDirectory const& directory) {
+  auto const& dir = directory.records;
+
+  std::map<std::string, uint64_t> offsets;
+  size_t pos = 0;
+  for (uint64_t i = 0; i < directory.num_entries; ++i) {
+    char const* const entry = &dir[pos];
+    if (pos + 46 > dir.size() || load_le<uint32_t>(entry) != 0x02014b50) {
+      throw std::runtime_error{"libcnpy++: zip central directory corrupt"};
+    }
+    uint16_t const name_length = load_le<uint16_t>(entry + 28);
+    uint16_t const extra_length = load_le<uint16_t>(entry + 30);
+    uint16_t const comment_length = load_le<uint16_t>(entry + 32);
+    if (pos + 46 + name_length + extra_length > dir.size()) {
+      throw std::runtime_error{"libcnpy++: zip central directory corrupt"};
+    }
+
+    uint64_t offset = load_le<uint32_t>(entry + 42);
+    if (offset == 0xffffffff) {
+      // 64 bit values in the zip64 extra field, in this order, for those
+      // fields which are 0xffffffff in the entry
+      char const* extra = entry + 46 + name_length;
+      char const* const extra_end = extra + extra_length;
+      while (extra + 4 <= extra_end) {
+        uint16_t const id = load_le<uint16_t>(extra);
+        uint16_t const size = load_le<uint16_t>(extra + 2);
+        if (id == 0x0001) {
+          size_t const skip =
+              8 * (load_le<uint32_t>(entry + 24) == 0xffffffff) +
+              8 * (load_le<uint32_t>(entry + 20) == 0xffffffff);
+          if (skip + 8 <= size) {
+            offset = load_le<uint64_t>(extra + 4 + skip);
+          }
+          break;
+        }
+        extra += 4 + size;
+      }
+    }
+
+    offsets.emplace(std::string{entry + 46, name_length}, offset);
+    pos += 46 + name_length + extra_length + comment_length;
+  }
+
+  return offsets;
+}
+
+// maps the data of a stored array directly from the archive, decompresses
+// other arrays into memory
+static cnpypp::NpyArray
+map_npy(std::string const& fname, zip_t* archive, zip_int64_t index,
+        std::map<std::string, uint64_t> const& local_header_offsets,
+        cnpypp::MappingOptions const& options) {
+  zip_stat_t fileinfo;
+  zip_stat_init(&fileinfo);
+  zip_stat_index(archive, index, ZIP_FL_ENC_RAW, &fileinfo);
+  if (!(fileinfo.valid & ZIP_STAT_COMP_METHOD) ||
+      fileinfo.comp_method != ZIP_CM_STORE ||
+      ((fileinfo.valid & ZIP_STAT_ENCRYPTION_METHOD) &&
+       fileinfo.encryption_method != ZIP_EM_NONE)) {
+    return load_npy(archive, index, {});
+  }
+
+  auto const it = local_header_offsets.find(fileinfo.name);
+  if (it == local_header_offsets.end()) {
+    throw std::runtime_error{"libcnpy++: zip entry not found"};
+  }
+
+  std::ifstream fs{fname, std::ios::binary};
+  char local_header[30];
+  fs.seekg(it->second);
+  fs.read(local_header, sizeof(local_header));
+  if (!fs || load_le<uint32_t>(local_header) != 0x04034b50) {
+    throw std::runtime_error{"libcnpy++: zip local header not found"};
+  }
+  uint64_t const entry_offset = it->second + sizeof(local_header) +
+                                load_le<uint16_t>(local_header + 26) +
+                                load_le<uint16_t>(local_header + 28);
+
+  NpyHeader header;
+  fs.seekg(entry_offset);
+  cnpypp::parse_npy_header(fs, header.word_sizes, header.data_types,
+                           header.labels, header.shape, header.memory_order);
+  uint64_t const data_offset = fs.tellg();
+  auto const num_bytes = header.num_bytes();
+
+  if (data_offset - entry_offset + num_bytes > fileinfo.size) {
+    throw std::runtime_error{"npz_load: array truncated in " + fname};
+  }
+
+  return cnpypp::NpyArray{
+      std::move(header.shape), std::move(header.word_sizes),
+      std::move(header.labels), header.memory_order,
+      std::make_unique<MemoryMappedBuffer>(fname, data_offset, num_bytes,
+                                           options)};
+}
+
+static zip_t* open_npz(std::string const& fname) {
   int errcode = 0;
   zip_t* const archive = zip_open(fname.c_str(), ZIP_RDONLY, &errcode);
   if (!archive) {
@@ -305,106 +640,1051 @@ cnpypp::npz_t cnpypp::npz_load(std::string const& fname) {
     zip_error_init_with_code(&err, errcode);
     throw std::runtime_error(zip_error_strerror(&err));
   }
+  return archive;
+}
 
-  cnpypp::npz_t arrays;
-  std::vector<std::string> names{};
+// indices and names (without ".npy") of the arrays in the archive
+static std::vector<std::pair<zip_int64_t, std::string>>
+npz_members(zip_t* archive) {
+  std::vector<std::pair<zip_int64_t, std::string>> members;
   zip_int64_t const num_files = zip_get_num_entries(archive, ZIP_FL_UNCHANGED);
   for (zip_int64_t i = 0; i < num_files; ++i) {
     char const* const filename = zip_get_name(archive, i, ZIP_FL_ENC_RAW);
     std::string_view const filename_view{filename};
-    auto const extension =
-        filename_view.substr(filename_view.size() - 4, filename_view.size());
 
-    if (extension != ".npy") {
+    if (filename_view.size() < 4 ||
+        filename_view.substr(filename_view.size() - 4) != ".npy") {
       std::cerr << "file contains file not ending with \".npy\" (\"" << filename
                 << "\"); skipping" << std::endl;
       continue;
     }
 
-    auto const stripped_name =
-        filename_view.substr(0, filename_view.size() - 4);
+    members.emplace_back(
+        i, std::string{filename_view.substr(0, filename_view.size() - 4)});
+  }
+  return members;
+}
 
-    // BREAK HERE INTO SUBFUNCION
-    auto array = load_npy(archive, i);
-    arrays.emplace(std::string{stripped_name}, std::move(array));
+cnpypp::npz_t cnpypp::npz_load(std::string const& fname,
+                               BufferAllocator const& allocator) {
+  zip_t* const archive = open_npz(fname);
+
+  cnpypp::npz_t arrays;
+  try {
+    for (auto& [index, name] : npz_members(archive)) {
+      arrays.emplace(std::move(name), load_npy(archive, index, allocator));
+    }
+  } catch (...) {
+    zip_discard(archive);
+    throw;
   }
 
   zip_close(archive);
   return arrays;
 }
+
+cnpypp::npz_t cnpypp::npz_load_parallel(std::string const& fname,
+                                        unsigned num_threads,
+                                        BufferAllocator const& allocator) {
+  zip_t* const archive = open_npz(fname);
+  auto members = npz_members(archive);
+  if (members.empty()) {
+    zip_discard(archive);
+    return {};
+  }
+
+  // largest arrays first, so that the threads finish at about the same time
+  std::vector<std::pair<zip_uint64_t, size_t>> order; // (size, member)
+  order.reserve(members.size());
+  for (size_t k = 0; k < members.size(); ++k) {
+    zip_stat_t fileinfo;
+    zip_stat_init(&fileinfo);
+    zip_stat_index(archive, members[k].first, ZIP_FL_ENC_RAW, &fileinfo);
+    order.emplace_back(fileinfo.size, k);
+  }
+  std::sort(order.begin(), order.end(), std::greater<>{});
+
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  num_threads = static_cast<unsigned>(
+      std::min<size_t>(std::max(num_threads, 1u), members.size()));
+
+  std::vector<std::optional<NpyArray>> arrays(members.size());
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto const fail = [&]() {
+    std::lock_guard<std::mutex> const lock{error_mutex};
+    if (!error) {
+      error = std::current_exception();
+    }
+    failed = true;
+  };
+
+  // zip_t handles must not be shared between threads
+  auto const work = [&](zip_t* handle) {
+    try {
+      for (size_t k; !failed && (k = next++) < order.size();) {
+        auto const member = order[k].second;
+        arrays[member].emplace(
+            load_npy(handle, members[member].first, allocator));
+      }
+    } catch (...) {
+      fail();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  try {
+    for (unsigned i = 1; i < num_threads; ++i) {
+      threads.emplace_back([&]() {
+        zip_t* handle;
+        try {
+          handle = open_npz(fname);
+        } catch (...) {
+          fail();
+          return;
+        }
+        work(handle);
+        zip_discard(handle);
+      });
+    }
+  } catch (...) { // thread creation failed, finish with the ones we have
+  }
+  work(archive);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  zip_discard(archive);
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  cnpypp::npz_t result;
+  for (size_t k = 0; k < members.size(); ++k) {
+    result.emplace(std::move(members[k].second), std::move(*arrays[k]));
+  }
+  return result;
+}
 #endif
 
 #ifndef NO_LIBZIP
 cnpypp::NpyArray cnpypp::npz_load(std::string const& fname,
-                                  std::string const& varname) {
-  int errcode = 0;
-  zip_t* const archive = zip_open(fname.c_str(), ZIP_RDONLY, &errcode);
-  if (!archive) {
-    zip_error_t err;
-    zip_error_init_with_code(&err, errcode);
-    throw std::runtime_error(zip_error_strerror(&err));
-  }
+                                  std::string const& varname,
+                                  BufferAllocator const& allocator) {
+  zip_t* const archive = open_npz(fname);
 
   std::string const full_filename = varname + ".npy";
   zip_int64_t const index =
       zip_name_locate(archive, full_filename.c_str(), ZIP_FL_ENC_RAW);
   if (index == -1) {
     // if we get here, we haven't found the variable in the file
+    zip_discard(archive);
     std::stringstream ss;
     ss << "npz_load: Variable name " << std::quoted(varname) << " not found in "
        << std::quoted(fname);
     throw std::runtime_error{ss.str().c_str()};
   }
 
-  auto array = load_npy(archive, index);
-  zip_close(archive);
-  return array;
+  try {
+    auto array = load_npy(archive, index, allocator);
+    zip_close(archive);
+    return array;
+  } catch (...) {
+    zip_discard(archive);
+    throw;
+  }
 }
-#endif
 
-cnpypp::NpyArray cnpypp::npy_load(std::string const& fname,
-                                  bool memory_mapped) {
-  std::ifstream fs{fname, std::ios::binary};
+cnpypp::NpyArray cnpypp::npz_load_mapped(std::string const& fname,
+                                         std::string const& varname,
+                                         MappingOptions const& options) {
+  zip_t* const archive = open_npz(fname);
 
-  if (!fs)
-    throw std::runtime_error("npy_load: Unable to open file " + fname);
+  std::string const full_filename = varname + ".npy";
+  zip_int64_t const index =
+      zip_name_locate(archive, full_filename.c_str(), ZIP_FL_ENC_RAW);
 
-  std::vector<unsigned> word_sizes;
-  std::vector<uint64_t> shape;
-  std::vector<char> data_types;
-  std::vector<std::string> labels;
-  cnpypp::MemoryOrder memory_order;
+  try {
+    if (index == -1) {
+      std::stringstream ss;
+      ss << "npz_load: Variable name " << std::quoted(varname)
+         << " not found in " << std::quoted(fname);
+      throw std::runtime_error{ss.str()};
+    }
 
-  cnpypp::parse_npy_header(fs, word_sizes, data_types, labels, shape,
-                           memory_order);
+    std::ifstream fs{fname, std::ios::binary};
+    auto array =
+        map_npy(fname, archive, index,
+                zip_local_header_offsets(read_central_directory(fs)), options);
+    zip_discard(archive);
+    return array;
+  } catch (...) {
+    zip_discard(archive);
+    throw;
+  }
+}
 
-  auto const num_vals = std::accumulate(shape.begin(), shape.end(), uint64_t{1},
-                                        std::multiplies<uint64_t>());
-  auto const total_value_size = std::accumulate(
-      word_sizes.begin(), word_sizes.end(), 0u, std::plus<unsigned>());
-  auto const num_bytes = total_value_size * num_vals;
+cnpypp::NpyArray cnpypp::npz_load_into(std::string const& fname,
+                                       std::string const& varname,
+                                       cnpypp::span<std::byte> dest) {
+  return npz_load(fname, varname, into_span(dest, "npz_load_into"));
+}
 
-  std::unique_ptr<Buffer> buffer;
+// reads only as much of the array as needed for its header
+static NpyHeader load_npy_header(zip_t* archive, zip_int64_t index) {
+  zip_file_t* const file = zip_fopen_index(archive, index, ZIP_FL_ENC_RAW);
+  if (!file) {
+    throw std::runtime_error{"libcnpy++: zip_fopen_index() failed"};
+  }
 
-  if (!memory_mapped) {
-    buffer = std::make_unique<InMemoryBuffer>(num_bytes);
-    fs.read(reinterpret_cast<char*>(buffer->data()), num_bytes);
-  } else {
-    buffer = std::make_unique<MemoryMappedBuffer>(fname, fs.tellg(), num_bytes);
+  std::vector<char> buffer;
+  try {
+    buffer = read_npy_header(file);
+  } catch (...) {
+    zip_fclose(file);
+    throw;
   }
+  zip_fclose(file);
 
-  return cnpypp::NpyArray{std::move(shape), std::move(word_sizes),
-                          std::move(labels), memory_order, std::move(buffer)};
+  NpyHeader header;
+  parse_npy_header(buffer.data(), header.word_sizes, header.data_types,
+                   header.labels, header.shape, header.memory_order);
+  return header;
 }
 
-std::vector<char>
-cnpypp::create_npy_header(cnpypp::span<uint64_t const> const shape,
-                          cnpypp::span<std::string_view const> labels,
-                          cnpypp::span<char const> dtypes,
-                          cnpypp::span<size_t const> sizes,
-                          MemoryOrder memory_order) {
-  std::vector<char> dict;
-  append(dict, "{'descr': [");
+cnpypp::NpzReader::NpzReader(std::string const& _fname)
+    : fname{_fname}, archive{open_npz(_fname), zip_discard} {
+  for (auto& [index, name] : npz_members(archive.get())) {
+    member_names.push_back(name);
+    members.emplace(std::move(name), Member{index, {}, {}});
+  }
+}
+
+bool cnpypp::NpzReader::contains(std::string const& name) const {
+  return members.count(name) != 0;
+}
+
+cnpypp::NpzReader::Member& cnpypp::NpzReader::member(std::string const& name) {
+  auto const it = members.find(name);
+  if (it == members.end()) {
+    std::stringstream ss;
+    ss << "NpzReader: Variable name " << std::quoted(name) << " not found in "
+       << std::quoted(fname);
+    throw std::runtime_error{ss.str()};
+  }
+  return it->second;
+}
+
+NpyHeader const& cnpypp::NpzReader::header(std::string const& name) {
+  auto& m = member(name);
+  if (!m.header) {
+    m.header.emplace(load_npy_header(archive.get(), m.index));
+  }
+  return *m.header;
+}
+
+cnpypp::NpyArray cnpypp::NpzReader::load(std::string const& name,
+                                         BufferAllocator const& allocator) {
+  return load_npy(archive.get(), member(name).index, allocator);
+}
+
+cnpypp::NpyArray const& cnpypp::NpzReader::get(std::string const& name) {
+  auto& m = member(name);
+  if (!m.array) {
+    m.array.emplace(load_npy(archive.get(), m.index, {}));
+  }
+  return *m.array;
+}
+
+cnpypp::NpyArray cnpypp::NpzReader::map(std::string const& name,
+                                        MappingOptions const& options) {
+  auto const index = member(name).index;
+  if (local_header_offsets.empty()) {
+    std::ifstream fs{fname, std::ios::binary};
+    local_header_offsets =
+        zip_local_header_offsets(read_central_directory(fs));
+  }
+  return map_npy(fname, archive.get(), index, local_header_offsets, options);
+}
+
+bool cnpypp::NpzReader::is_cached(std::string const& name) const {
+  auto const it = members.find(name);
+  return it != members.end() && it->second.array.has_value();
+}
+
+void cnpypp::NpzReader::evict(std::string const& name) {
+  member(name).array.reset();
+}
+
+void cnpypp::NpzReader::clear_cache() {
+  for (auto& [name, m] : members) {
+    m.array.reset();
+  }
+}
+#endif
+
+// calls task(i, read_at, scratch) for all i in [0, num_tasks) on num_threads
+// threads. read_at(ptr, size, pos) reads size bytes at position pos of the
+// file with positional reads and returns false if the file is too short.
+// scratch is a buffer owned by the calling thread. returns false if a task
+// failed; the first exception thrown by a task is rethrown after all threads
+// have finished
+template <typename Task>
+static bool read_concurrently(std::string const& fname, char const* caller,
+                              uint64_t num_tasks, unsigned num_threads,
+                              Task const& task) {
+  if (num_tasks == 0) {
+    return true;
+  }
+  num_threads = static_cast<unsigned>(
+      std::min<uint64_t>(std::max(num_threads, 1u), num_tasks));
+
+#if defined(__unix__) || defined(__APPLE__)
+  int const fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error(std::string{caller} + ": Unable to open file " +
+                             fname);
+  }
+  struct FdGuard {
+    int const fd;
+    ~FdGuard() { ::close(fd); }
+  } const fd_guard{fd};
+
+  auto const read_at = [fd](std::byte* ptr, size_t size, uint64_t pos) {
+    while (size > 0) {
+      auto const n = ::pread(fd, ptr, size, static_cast<off_t>(pos));
+      if (n == -1 && errno == EINTR) {
+        continue;
+      } else if (n <= 0) {
+        return false;
+      }
+      ptr += n;
+      pos += n;
+      size -= n;
+    }
+    return true;
+  };
+#endif
+
+  std::atomic<uint64_t> next_task{0};
+  std::atomic<bool> failed{false};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+
+  // never throws, so that all threads can be joined
+  auto const work = [&]() {
+    try {
+#if !(defined(__unix__) || defined(__APPLE__))
+      // no pread(): every thread uses its own stream
+      std::ifstream fs{fname, std::ios::binary};
+      auto const read_at = [&fs](std::byte* ptr, size_t size, uint64_t pos) {
+        fs.seekg(pos);
+        fs.read(reinterpret_cast<char*>(ptr), size);
+        return static_cast<bool>(fs);
+      };
+#endif
+      std::vector<std::byte> scratch;
+      for (uint64_t i; !failed && (i = next_task++) < num_tasks;) {
+        if (!task(i, read_at, scratch)) {
+          failed = true;
+        }
+      }
+    } catch (...) {
+      std::lock_guard const lock{error_mutex};
+      if (!error) {
+        error = std::current_exception();
+      }
+      failed = true;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  try {
+    for (unsigned i = 1; i < num_threads; ++i) {
+      threads.emplace_back(work);
+    }
+  } catch (...) { // thread creation failed, finish with the ones we have
+  }
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return !failed;
+}
+
+// reads num_bytes at offset of the file into dest. the range is split into
+// chunks of chunk_size bytes which num_threads threads read concurrently with
+// positional reads
+static void read_parallel(std::string const& fname, uint64_t offset,
+                          std::byte* dest, uint64_t num_bytes,
+                          unsigned num_threads, size_t chunk_size) {
+  uint64_t const num_chunks = (num_bytes + chunk_size - 1) / chunk_size;
+
+  auto const read_chunk = [&](uint64_t chunk, auto const& read_at, auto&) {
+    uint64_t const begin = chunk * chunk_size;
+    auto const size = static_cast<size_t>(
+        std::min<uint64_t>(chunk_size, num_bytes - begin));
+    return read_at(dest + begin, size, offset + begin);
+  };
+
+  if (!read_concurrently(fname, "npy_load_parallel", num_chunks, num_threads,
+                         read_chunk)) {
+    throw std::runtime_error("npy_load_parallel: file truncated " + fname);
+  }
+}
+
+// with num_threads > 1, the payload is read by read_parallel()
+static cnpypp::NpyArray
+npy_load_impl(std::string const& fname,
+              cnpypp::MappingOptions const* mapping_options,
+              cnpypp::BufferAllocator const& allocator,
+              unsigned num_threads = 1, size_t chunk_size = 0) {
+  std::ifstream fs{fname, std::ios::binary};
+
+  if (!fs)
+    throw std::runtime_error("npy_load: Unable to open file " + fname);
+
+  std::vector<unsigned> word_sizes;
+  std::vector<uint64_t> shape;
+  std::vector<char> data_types;
+  std::vector<std::string> labels;
+  cnpypp::MemoryOrder memory_order;
+
+  cnpypp::parse_npy_header(fs, word_sizes, data_types, labels, shape,
+                           memory_order);
+
+  auto const num_vals = std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                                        std::multiplies<uint64_t>());
+  auto const total_value_size = std::accumulate(
+      word_sizes.begin(), word_sizes.end(), 0u, std::plus<unsigned>());
+  auto const num_bytes = total_value_size * num_vals;
+
+  std::unique_ptr<Buffer> buffer;
+  uint64_t const data_offset = fs.tellg();
+
+  if (!mapping_options) {
+    // give the data in memory the same alignment as in the file, i.e. the
+    // largest power of 2 dividing the offset (at most 2 MiB)
+    size_t const alignment = std::max<size_t>(
+        std::min<uint64_t>(data_offset & (~data_offset + 1), 0x200000),
+        alignof(std::max_align_t));
+    buffer = allocate_buffer(allocator, num_bytes, alignment);
+
+    if (num_threads > 1 && num_bytes > chunk_size) {
+      fs.close();
+      read_parallel(fname, data_offset, buffer->data(), num_bytes, num_threads,
+                    chunk_size);
+    } else {
+      fs.read(reinterpret_cast<char*>(buffer->data()), num_bytes);
+
+      if (!fs) {
+        throw std::runtime_error("npy_load: file truncated " + fname);
+      }
+    }
+  } else {
+    // data start at the beginning of the mapping if the offset is a multiple
+    // of the page size
+    buffer = std::make_unique<MemoryMappedBuffer>(fname, data_offset,
+                                                  num_bytes, *mapping_options);
+  }
+
+  return cnpypp::NpyArray{std::move(shape), std::move(word_sizes),
+                          std::move(labels), memory_order, std::move(buffer)};
+}
+
+cnpypp::NpyArray cnpypp::npy_load(std::string const& fname,
+                                  bool memory_mapped) {
+  cnpypp::MappingOptions const options{};
+  return npy_load_impl(fname, memory_mapped ? &options : nullptr, {});
+}
+
+cnpypp::NpyArray cnpypp::npy_load_mapped(std::string const& fname,
+                                         MappingOptions const& options) {
+  return npy_load_impl(fname, &options, {});
+}
+
+cnpypp::NpyArray cnpypp::npy_load(std::string const& fname,
+                                  BufferAllocator const& allocator) {
+  return npy_load_impl(fname, nullptr, allocator);
+}
+
+cnpypp::NpyArray cnpypp::npy_load_into(std::string const& fname,
+                                       cnpypp::span<std::byte> dest) {
+  return npy_load_impl(fname, nullptr, into_span(dest, "npy_load_into"));
+}
+
+cnpypp::NpyArray cnpypp::npy_load_parallel(std::string const& fname,
+                                           unsigned num_threads,
+                                           size_t chunk_size,
+                                           BufferAllocator const& allocator) {
+  if (chunk_size == 0) {
+    throw std::runtime_error("npy_load_parallel: chunk_size must not be 0");
+  }
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  return npy_load_impl(fname, nullptr, allocator, num_threads, chunk_size);
+}
+
+cnpypp::NpyArray
+cnpypp::npy_load_hyperslab(std::string const& fname,
+                           cnpypp::span<AxisSelection const> selection,
+                           unsigned num_threads,
+                           BufferAllocator const& allocator) {
+  std::ifstream fs{fname, std::ios::binary};
+
+  if (!fs)
+    throw std::runtime_error("npy_load_hyperslab: Unable to open file " +
+                             fname);
+
+  NpyHeader header;
+  cnpypp::parse_npy_header(fs, header.word_sizes, header.data_types,
+                           header.labels, header.shape, header.memory_order);
+  uint64_t const data_offset = fs.tellg();
+  fs.close();
+
+  auto const rank = header.shape.size();
+  if (selection.size() != rank) {
+    throw std::runtime_error(
+        "npy_load_hyperslab: selection does not match rank of array");
+  }
+
+  // axes in the order of storage, slowest first
+  std::vector<uint64_t> dims{header.shape.begin(), header.shape.end()};
+  std::vector<AxisSelection> sel{selection.begin(), selection.end()};
+  if (header.memory_order == MemoryOrder::Fortran) {
+    std::reverse(dims.begin(), dims.end());
+    std::reverse(sel.begin(), sel.end());
+  }
+
+  header.shape.clear();
+  for (auto const& s : selection) {
+    header.shape.push_back(s.count);
+  }
+
+  for (size_t k = 0; k < rank; ++k) {
+    if (sel[k].stride == 0 ||
+        (sel[k].count > 0 &&
+         (sel[k].start >= dims[k] ||
+          (sel[k].count - 1) > (dims[k] - 1 - sel[k].start) / sel[k].stride))) {
+      throw std::runtime_error("npy_load_hyperslab: selection out of range");
+    }
+  }
+
+  // distances of consecutive indices in the file
+  uint64_t const value_size = std::accumulate(
+      header.word_sizes.begin(), header.word_sizes.end(), uint64_t{0});
+  std::vector<uint64_t> byte_strides(rank);
+  for (size_t k = rank; k-- > 0;) {
+    byte_strides[k] = k + 1 < rank ? byte_strides[k + 1] * dims[k + 1]
+                                   : value_size;
+  }
+
+  // the fastest axes form contiguous runs of run_bytes bytes as long as their
+  // indices are consecutive; the others (outer axes) are iterated
+  uint64_t run_bytes = value_size;
+  uint64_t run_offset = data_offset;
+  size_t outer_rank = rank;
+  while (outer_rank > 0) {
+    auto const& s = sel[outer_rank - 1];
+    if (s.stride != 1 && s.count > 1) {
+      break;
+    }
+    --outer_rank;
+    run_bytes *= s.count;
+    run_offset += s.start * byte_strides[outer_rank];
+    if (s.count != dims[outer_rank]) {
+      break;
+    }
+  }
+
+  uint64_t const num_runs =
+      std::accumulate(sel.begin(), sel.begin() + outer_rank, uint64_t{1},
+                      [](uint64_t n, auto const& s) { return n * s.count; });
+  auto buffer = allocate_buffer(allocator, num_runs * run_bytes);
+  if (num_runs * run_bytes == 0) {
+    return NpyArray{std::move(header.shape), std::move(header.word_sizes),
+                    std::move(header.labels), header.memory_order,
+                    std::move(buffer)};
+  }
+
+  // position of run r in the file
+  auto const run_position = [&](uint64_t r) {
+    uint64_t pos = run_offset;
+    for (size_t k = outer_rank; k-- > 0;) {
+      pos += (sel[k].start + (r % sel[k].count) * sel[k].stride) *
+             byte_strides[k];
+      r /= sel[k].count;
+    }
+    return pos;
+  };
+
+  // coalesce runs with small gaps into larger reads
+  uint64_t constexpr max_gap = 0x10000;
+  uint64_t constexpr max_read = 0x400000;
+  struct Read {
+    uint64_t first_run, num_runs, begin, end;
+  };
+  std::vector<Read> reads;
+  for (uint64_t r = 0; r < num_runs; ++r) {
+    auto const pos = run_position(r);
+    if (!reads.empty() && pos - reads.back().end <= max_gap &&
+        pos + run_bytes - reads.back().begin <= max_read) {
+      reads.back().num_runs += 1;
+      reads.back().end = pos + run_bytes;
+    } else {
+      reads.push_back(Read{r, 1, pos, pos + run_bytes});
+    }
+  }
+
+  std::byte* const dest = buffer->data();
+  auto const read_runs = [&](uint64_t i, auto const& read_at,
+                             std::vector<std::byte>& scratch) {
+    auto const& read = reads[i];
+    std::byte* const out = dest + read.first_run * run_bytes;
+    if (read.end - read.begin == read.num_runs * run_bytes) {
+      return read_at(out, read.end - read.begin, read.begin); // no gaps
+    }
+
+    scratch.resize(read.end - read.begin);
+    if (!read_at(scratch.data(), scratch.size(), read.begin)) {
+      return false;
+    }
+    for (uint64_t j = 0; j < read.num_runs; ++j) {
+      auto const pos = run_position(read.first_run + j);
+      std::copy_n(&scratch[pos - read.begin], run_bytes,
+                  out + j * run_bytes);
+    }
+    return true;
+  };
+
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  if (!read_concurrently(fname, "npy_load_hyperslab", reads.size(),
+                         num_threads, read_runs)) {
+    throw std::runtime_error("npy_load_hyperslab: file truncated " + fname);
+  }
+
+  return NpyArray{std::move(header.shape), std::move(header.word_sizes),
+                  std::move(header.labels), header.memory_order,
+                  std::move(buffer)};
+}
+
+// parses the header of the file and reduces the shape to the rows
+// [first, first + count). returns the offset of the first row in the file
+static uint64_t locate_rows(std::ifstream& fs, std::string const& fname,
+                            uint64_t first, uint64_t count,
+                            cnpypp::NpyHeader& header) {
+  if (!fs)
+    throw std::runtime_error("npy_load_rows: Unable to open file " + fname);
+
+  cnpypp::parse_npy_header(fs, header.word_sizes, header.data_types,
+                           header.labels, header.shape, header.memory_order);
+
+  if (header.shape.empty()) {
+    throw std::runtime_error("npy_load_rows: array has no rows");
+  } else if (header.memory_order == MemoryOrder::Fortran &&
+             header.shape.size() > 1) {
+    throw std::runtime_error(
+        "npy_load_rows: rows of arrays in Fortran order are not contiguous");
+  } else if (first > header.shape[0] || count > header.shape[0] - first) {
+    throw std::runtime_error("npy_load_rows: rows out of range");
+  }
+
+  header.shape[0] = 1;
+  uint64_t const row_bytes = header.num_bytes();
+  header.shape[0] = count;
+
+  return static_cast<uint64_t>(fs.tellg()) + first * row_bytes;
+}
+
+cnpypp::NpyArray cnpypp::npy_load_rows(std::string const& fname,
+                                       uint64_t first, uint64_t count,
+                                       BufferAllocator const& allocator) {
+  std::ifstream fs{fname, std::ios::binary};
+  NpyHeader header;
+  auto const offset = locate_rows(fs, fname, first, count, header);
+  auto const num_bytes = header.num_bytes();
+
+  auto buffer = allocate_buffer(allocator, num_bytes);
+  fs.seekg(offset);
+  fs.read(reinterpret_cast<char*>(buffer->data()), num_bytes);
+  if (!fs) {
+    throw std::runtime_error("npy_load_rows: file truncated " + fname);
+  }
+
+  return cnpypp::NpyArray{std::move(header.shape),
+                          std::move(header.word_sizes),
+                          std::move(header.labels), header.memory_order,
+                          std::move(buffer)};
+}
+
+cnpypp::NpyArray cnpypp::npy_load_rows_mapped(std::string const& fname,
+                                              uint64_t first, uint64_t count,
+                                              MappingOptions const& options) {
+  std::ifstream fs{fname, std::ios::binary};
+  NpyHeader header;
+  auto const offset = locate_rows(fs, fname, first, count, header);
+  auto const num_bytes = header.num_bytes();
+  fs.close();
+
+  return cnpypp::NpyArray{
+      std::move(header.shape), std::move(header.word_sizes),
+      std::move(header.labels), header.memory_order,
+      std::make_unique<MemoryMappedBuffer>(fname, offset, num_bytes, options)};
+}
+
+// copies n values of N bytes each, stride bytes apart in src, to consecutive
+// positions in dest (or the other way round with Scatter). with the size known
+// at compile time, every memcpy() becomes a single load and store
+template <size_t N, bool Scatter>
+static void strided_copy_n(std::byte const* src, std::byte* dest,
+                           size_t stride, uint64_t n) {
+  for (uint64_t i = 0; i < n; ++i) {
+    if constexpr (Scatter) {
+      std::memcpy(dest + i * stride, src + i * N, N);
+    } else {
+      std::memcpy(dest + i * N, src + i * stride, N);
+    }
+  }
+}
+
+template <bool Scatter>
+static void strided_copy(std::byte const* src, std::byte* dest,
+                         size_t word_size, size_t stride, uint64_t n) {
+  switch (word_size) {
+  case 1:
+    return strided_copy_n<1, Scatter>(src, dest, stride, n);
+  case 2:
+    return strided_copy_n<2, Scatter>(src, dest, stride, n);
+  case 4:
+    return strided_copy_n<4, Scatter>(src, dest, stride, n);
+  case 8:
+    return strided_copy_n<8, Scatter>(src, dest, stride, n);
+  case 16:
+    return strided_copy_n<16, Scatter>(src, dest, stride, n);
+  default:
+    for (uint64_t i = 0; i < n; ++i) {
+      if constexpr (Scatter) {
+        std::memcpy(dest + i * stride, src + i * word_size, word_size);
+      } else {
+        std::memcpy(dest + i * word_size, src + i * stride, word_size);
+      }
+    }
+  }
+}
+
+// de-interleaves the fields at offsets of n records of record_size bytes into
+// the columns. the records are processed in blocks which stay in the cache
+// while all of their fields are copied
+static void gather_columns(std::byte const* records, size_t record_size,
+                           std::vector<size_t> const& offsets,
+                           std::vector<unsigned> const& word_sizes, uint64_t n,
+                           std::vector<std::byte*> const& columns) {
+  uint64_t const block =
+      std::max<uint64_t>(0x10000 / std::max<size_t>(record_size, 1), 1);
+  for (uint64_t begin = 0; begin < n; begin += block) {
+    auto const count = std::min(block, n - begin);
+    for (size_t j = 0; j < columns.size(); ++j) {
+      strided_copy<false>(records + begin * record_size + offsets[j],
+                          columns[j] + begin * word_sizes[j], word_sizes[j],
+                          record_size, count);
+    }
+  }
+}
+
+std::vector<cnpypp::NpyArray> cnpypp::NpyArray::to_columns() const {
+  std::vector<size_t> offsets;
+  std::vector<std::byte*> columns;
+  std::vector<NpyArray> arrays;
+  arrays.reserve(word_sizes.size());
+  for (size_t j = 0; j < word_sizes.size(); ++j) {
+    offsets.push_back(std::accumulate(
+        word_sizes.cbegin(), std::next(word_sizes.cbegin(), j), size_t{0}));
+    arrays.emplace_back(shape, std::vector<unsigned>{word_sizes[j]},
+                        std::vector<std::string>{}, memory_order,
+                        std::make_unique<InMemoryBuffer>(
+                            num_vals * word_sizes[j], 64));
+    columns.push_back(arrays.back().data<std::byte>());
+  }
+
+  gather_columns(data<std::byte>(), total_value_size, offsets, word_sizes,
+                 num_vals, columns);
+  return arrays;
+}
+
+cnpypp::NpyArray
+cnpypp::from_columns(cnpypp::span<NpyArray const> columns,
+                     cnpypp::span<std::string_view const> labels) {
+  if (columns.empty() || columns.size() != labels.size()) {
+    throw std::runtime_error(
+        "from_columns: number of columns and labels do not match");
+  }
+  for (auto const& column : columns) {
+    if (column.word_sizes.size() != 1 || column.shape != columns[0].shape ||
+        column.memory_order != columns[0].memory_order) {
+      throw std::runtime_error(
+          "from_columns: columns must be non-structured arrays of equal shape");
+    }
+  }
+
+  std::vector<unsigned> word_sizes;
+  for (auto const& column : columns) {
+    word_sizes.push_back(column.word_sizes[0]);
+  }
+  auto const record_size =
+      std::accumulate(word_sizes.cbegin(), word_sizes.cend(), size_t{0});
+  auto const num_vals = columns[0].num_vals;
+
+  auto buffer = std::make_unique<InMemoryBuffer>(num_vals * record_size);
+  std::byte* const records = buffer->data();
+
+  uint64_t const block =
+      std::max<uint64_t>(0x10000 / std::max<size_t>(record_size, 1), 1);
+  for (uint64_t begin = 0; begin < num_vals; begin += block) {
+    auto const count = std::min(block, num_vals - begin);
+    size_t offset = 0;
+    for (size_t j = 0; j < columns.size(); ++j) {
+      strided_copy<true>(columns[j].data<std::byte>() + begin * word_sizes[j],
+                         records + begin * record_size + offset,
+                         word_sizes[j], record_size, count);
+      offset += word_sizes[j];
+    }
+  }
+
+  return NpyArray{columns[0].shape, std::move(word_sizes),
+                  std::vector<std::string>{labels.begin(), labels.end()},
+                  columns[0].memory_order, std::move(buffer)};
+}
+
+namespace {
+// the requested fields of a structured array in a file, with the data
+// mapped read-only
+struct FieldProjection {
+  cnpypp::NpyHeader header;
+  std::vector<size_t> offsets; // of the requested fields within a record
+  std::vector<unsigned> word_sizes;
+  std::vector<std::string> labels;
+  size_t record_size;
+  std::unique_ptr<Buffer const> data; // read-only mapping
+};
+} // namespace
+
+static FieldProjection
+project_fields(std::string const& fname,
+               cnpypp::span<std::string_view const> labels) {
+  std::ifstream fs{fname, std::ios::binary};
+
+  if (!fs)
+    throw std::runtime_error("npy_load_columns: Unable to open file " + fname);
+
+  FieldProjection projection;
+  auto& header = projection.header;
+  cnpypp::parse_npy_header(fs, header.word_sizes, header.data_types,
+                           header.labels, header.shape, header.memory_order);
+  uint64_t const data_offset = fs.tellg();
+  fs.close();
+
+  if (header.labels.empty()) {
+    throw std::runtime_error("npy_load_columns: not a structured array");
+  }
+
+  for (auto const& label : labels) {
+    auto const it =
+        std::find(header.labels.cbegin(), header.labels.cend(), label);
+    if (it == header.labels.cend()) {
+      std::stringstream ss;
+      ss << "npy_load_columns: " << std::quoted(label)
+         << " not found in labels";
+      throw std::runtime_error{ss.str()};
+    }
+    auto const d = std::distance(header.labels.cbegin(), it);
+    projection.offsets.push_back(
+        std::accumulate(header.word_sizes.cbegin(),
+                        std::next(header.word_sizes.cbegin(), d), size_t{0}));
+    projection.word_sizes.push_back(header.word_sizes[d]);
+    projection.labels.emplace_back(label);
+  }
+
+  projection.record_size = std::accumulate(
+      header.word_sizes.cbegin(), header.word_sizes.cend(), size_t{0});
+
+  // with records spanning several pages, the pages containing none of the
+  // requested fields are never read
+  if (auto const num_bytes = header.num_bytes(); num_bytes > 0) {
+    MappingOptions options;
+    options.read_only = true;
+    options.advice = projection.record_size >= 0x2000
+                         ? MappingOptions::Advice::Random
+                         : MappingOptions::Advice::Sequential;
+    projection.data = std::make_unique<MemoryMappedBuffer>(fname, data_offset,
+                                                           num_bytes, options);
+  }
+
+  return projection;
+}
+
+cnpypp::NpyArray
+cnpypp::npy_load_columns(std::string const& fname,
+                         cnpypp::span<std::string_view const> labels,
+                         BufferAllocator const& allocator) {
+  auto projection = project_fields(fname, labels);
+  auto const num_vals = projection.header.num_vals();
+  size_t const out_record_size =
+      std::accumulate(projection.word_sizes.cbegin(),
+                      projection.word_sizes.cend(), size_t{0});
+
+  auto buffer = allocate_buffer(allocator, num_vals * out_record_size);
+  if (projection.data) {
+    std::byte const* src = projection.data->data();
+    std::byte* dest = buffer->data();
+    for (uint64_t i = 0; i < num_vals; ++i) {
+      for (size_t j = 0; j < projection.offsets.size(); ++j) {
+        std::memcpy(dest, src + projection.offsets[j],
+                    projection.word_sizes[j]);
+        dest += projection.word_sizes[j];
+      }
+      src += projection.record_size;
+    }
+  }
+
+  return cnpypp::NpyArray{std::move(projection.header.shape),
+                          std::move(projection.word_sizes),
+                          std::move(projection.labels),
+                          projection.header.memory_order, std::move(buffer)};
+}
+
+std::vector<cnpypp::NpyArray>
+cnpypp::npy_load_column_arrays(std::string const& fname,
+                               cnpypp::span<std::string_view const> labels,
+                               BufferAllocator const& allocator) {
+  auto projection = project_fields(fname, labels);
+  auto const num_vals = projection.header.num_vals();
+
+  std::vector<std::byte*> columns;
+  std::vector<cnpypp::NpyArray> arrays;
+  arrays.reserve(labels.size());
+  for (auto const word_size : projection.word_sizes) {
+    arrays.emplace_back(projection.header.shape,
+                        std::vector<unsigned>{word_size},
+                        std::vector<std::string>{},
+                        projection.header.memory_order,
+                        allocate_buffer(allocator, num_vals * word_size));
+    columns.push_back(arrays.back().data<std::byte>());
+  }
+
+  if (projection.data) {
+    gather_columns(projection.data->data(), projection.record_size,
+                   projection.offsets, projection.word_sizes, num_vals,
+                   columns);
+  }
+
+  return arrays;
+}
+
+// builds a header of exactly header_size bytes from the preamble and the dict,
+// padded with spaces and terminated by \n. version 2.0 of the format is used
+// only if the dict is too long for version 1.0.
+static std::vector<char> make_npy_header(std::string_view dict,
+                                         size_t header_size) {
+  bool const v1 = header_size - 10 <= std::numeric_limits<uint16_t>::max();
+  size_t const preamble_size = v1 ? 10 : 12;
+
+  if (header_size < preamble_size + dict.size() + 1 ||
+      header_size - preamble_size > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("create_npy_header: invalid header size");
+  }
+
+  std::vector<char> header;
+  header.reserve(header_size);
+  header += (char)0x93;
+  append(header, "NUMPY");
+  header += (char)(v1 ? 0x01 : 0x02); // major version of numpy format
+  header += (char)0x00;               // minor version of numpy format
+  if (v1) {
+    header += (uint16_t)(header_size - preamble_size);
+  } else {
+    header += (uint32_t)(header_size - preamble_size);
+  }
+  append(header, dict);
+  header.resize(header_size, ' ');
+  header.back() = '\n';
+
+  return header;
+}
+
+// appends shape and memory order to the dict, pads it and prepends the
+// preamble. if header_capacity is non-zero, the header is made large enough
+// to hold any shape of the same rank without changing its size.
+static std::vector<char> finish_npy_header(std::vector<char>& dict,
+                                           cnpypp::span<uint64_t const> shape,
+                                           MemoryOrder memory_order,
+                                           size_t header_capacity,
+                                           size_t data_alignment) {
+  if (data_alignment < 16 || (data_alignment & (data_alignment - 1)) != 0) {
+    throw std::runtime_error(
+        "create_npy_header: data_alignment must be a power of 2 >= 16");
+  }
+
+  append(dict, "'fortran_order': ");
+  append(dict, (memory_order == MemoryOrder::C) ? "False" : "True");
+  append(dict, ", 'shape': (");
+  append(dict, std::to_string(shape[0]));
+  for (size_t i = 1; i < shape.size(); i++) {
+    append(dict, ", ");
+    append(dict, std::to_string(shape[i]));
+  }
+  if (shape.size() == 1) {
+    append(dict, ",");
+  }
+  append(dict, "), }");
+
+  // pad with spaces so that preamble+dict is a multiple of data_alignment.
+  // dict needs to end with \n
+  size_t dict_size = dict.size() + 1;
+
+  if (header_capacity > 0) {
+    size_t constexpr max_digits = std::numeric_limits<uint64_t>::digits10 + 1;
+    for (auto const dim : shape) {
+      dict_size += max_digits - std::to_string(dim).size();
+    }
+  }
+
+  auto const padded_size = [&](size_t preamble_size) {
+    size_t const size = std::max(preamble_size + dict_size, header_capacity);
+    return (size + data_alignment - 1) / data_alignment * data_alignment;
+  };
+
+  size_t header_size = padded_size(10);
+  if (header_size - 10 > std::numeric_limits<uint16_t>::max()) {
+    header_size = padded_size(12); // requires format version 2.0
+  }
+
+  return make_npy_header(std::string_view{dict.data(), dict.size()},
+                         header_size);
+}
+
+std::vector<char>
+cnpypp::create_npy_header(cnpypp::span<uint64_t const> const shape,
+                          cnpypp::span<std::string_view const> labels,
+                          cnpypp::span<char const> dtypes,
+                          cnpypp::span<size_t const> sizes,
+                          MemoryOrder memory_order, size_t header_capacity,
+                          size_t data_alignment) {
+  std::vector<char> dict;
+  append(dict, "{'descr': [");
 
   if (labels.size() != dtypes.size() || dtypes.size() != sizes.size() ||
       sizes.size() != labels.size()) {
@@ -434,72 +1714,177 @@ cnpypp::create_npy_header(cnpypp::span<uint64_t const> const shape,
     dict.push_back(',');
   }
 
-  append(dict, "], 'fortran_order': ");
-  append(dict, (memory_order == MemoryOrder::C) ? "False" : "True");
-  append(dict, ", 'shape': (");
-  append(dict, std::to_string(shape[0]));
-  for (size_t i = 1; i < shape.size(); i++) {
-    append(dict, ", ");
-    append(dict, std::to_string(shape[i]));
+  append(dict, "], ");
+
+  return finish_npy_header(dict, shape, memory_order, header_capacity,
+                           data_alignment);
+}
+
+std::vector<char>
+cnpypp::create_npy_header(cnpypp::span<uint64_t const> const shape, char dtype,
+                          unsigned wordsize, MemoryOrder memory_order,
+                          size_t header_capacity, size_t data_alignment) {
+  std::vector<char> dict;
+  append(dict, "{'descr': '");
+  dict += BigEndianTest();
+  dict.push_back(dtype);
+  append(dict, std::to_string(wordsize));
+  append(dict, "', ");
+
+  return finish_npy_header(dict, shape, memory_order, header_capacity,
+                           data_alignment);
+}
+
+// extends the file to size bytes. on Linux, the disk space is allocated, so
+// that running out of space is reported here rather than by SIGBUS when
+// writing to the mapping
+static void preallocate(std::string const& fname, uint64_t size) {
+#if defined(__linux__)
+  int const fd = ::open(fname.c_str(), O_WRONLY);
+  if (fd == -1) {
+    throw std::runtime_error("npy_create_mapped: Unable to open file " + fname);
   }
-  if (shape.size() == 1) {
-    append(dict, ",");
+  int const err = posix_fallocate(fd, 0, size);
+  ::close(fd);
+  if (err != 0) {
+    throw std::runtime_error(
+        std::string{"npy_create_mapped: posix_fallocate() failed: "} +
+        std::strerror(err));
   }
-  append(dict, "), }");
+#else
+  boost::filesystem::resize_file(fname, size);
+#endif
+}
+
+static cnpypp::NpyArray create_mapped(std::string const& fname,
+                                      std::vector<char> const& header,
+                                      std::vector<uint64_t> shape,
+                                      std::vector<unsigned> word_sizes,
+                                      std::vector<std::string> labels,
+                                      MemoryOrder memory_order) {
+  auto const num_vals = std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                                        std::multiplies<uint64_t>());
+  auto const total_value_size = std::accumulate(
+      word_sizes.begin(), word_sizes.end(), 0u, std::plus<unsigned>());
+  auto const num_bytes = total_value_size * num_vals;
+
+  {
+    std::ofstream fs{fname, std::ios::binary | std::ios::trunc};
+    fs.write(header.data(), header.size());
+    if (!fs) {
+      throw std::runtime_error("npy_create_mapped: Unable to write file " +
+                               fname);
+    }
+  }
+
+  preallocate(fname, header.size() + num_bytes);
+
+  return cnpypp::NpyArray{
+      std::move(shape), std::move(word_sizes), std::move(labels), memory_order,
+      std::make_unique<WritableMappedBuffer>(fname, header.size(), num_bytes)};
+}
+
+cnpypp::NpyArray cnpypp::npy_create_mapped(std::string const& fname,
+                                           cnpypp::span<uint64_t const> shape,
+                                           char dtype, unsigned size,
+                                           MemoryOrder memory_order,
+                                           size_t data_alignment) {
+  return create_mapped(fname,
+                       create_npy_header(shape, dtype, size, memory_order, 0,
+                                         data_alignment),
+                       {shape.begin(), shape.end()}, {size}, {}, memory_order);
+}
+
+cnpypp::NpyArray cnpypp::npy_create_mapped(
+    std::string const& fname, cnpypp::span<uint64_t const> shape,
+    cnpypp::span<std::string_view const> labels,
+    cnpypp::span<char const> dtypes, cnpypp::span<size_t const> sizes,
+    MemoryOrder memory_order, size_t data_alignment) {
+  return create_mapped(fname,
+                       create_npy_header(shape, labels, dtypes, sizes,
+                                         memory_order, 0, data_alignment),
+                       {shape.begin(), shape.end()},
+                       {sizes.begin(), sizes.end()},
+                       {labels.begin(), labels.end()}, memory_order);
+}
+
+cnpypp::NpyArray cnpypp::npy_open_mapped_rw(std::string const& fname) {
+  std::ifstream fs{fname, std::ios::binary};
+
+  if (!fs)
+    throw std::runtime_error("npy_open_mapped_rw: Unable to open file " +
+                             fname);
+
+  std::vector<unsigned> word_sizes;
+  std::vector<uint64_t> shape;
+  std::vector<char> data_types;
+  std::vector<std::string> labels;
+  cnpypp::MemoryOrder memory_order;
+
+  cnpypp::parse_npy_header(fs, word_sizes, data_types, labels, shape,
+                           memory_order);
+
+  auto const num_vals = std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                                        std::multiplies<uint64_t>());
+  auto const total_value_size = std::accumulate(
+      word_sizes.begin(), word_sizes.end(), 0u, std::plus<unsigned>());
+  auto const num_bytes = total_value_size * num_vals;
+  uint64_t const data_offset = fs.tellg();
 
-  // pad with spaces so that preamble+dict is modulo 16 bytes. preamble is 10
-  // bytes. dict needs to end with \n
-  int const remainder = 16 - (10 + dict.size()) % 16;
-  dict.insert(dict.end(), remainder, ' ');
-  dict.back() = '\n';
+  // writing to a mapping beyond the end of the file crashes the program
+  if (boost::filesystem::file_size(fname) < data_offset + num_bytes) {
+    throw std::runtime_error("npy_open_mapped_rw: file truncated " + fname);
+  }
 
-  std::vector<char> header;
-  header += (char)0x93;
-  append(header, "NUMPY");
-  header += (char)0x01; // major version of numpy format
-  header += (char)0x00; // minor version of numpy format
-  header += (uint16_t)dict.size();
-  header.insert(header.end(), dict.begin(), dict.end());
+  return cnpypp::NpyArray{
+      std::move(shape), std::move(word_sizes), std::move(labels), memory_order,
+      std::make_unique<WritableMappedBuffer>(fname, data_offset, num_bytes)};
+}
 
-  return header;
+// re-pads an NPY header created by create_npy_header() to a total size of
+// exactly new_size bytes
+static void resize_npy_header(std::vector<char>& header, size_t new_size) {
+  auto const preamble_size = npy_preamble_size(header[6]);
+  auto const dict_end =
+      std::find(header.rbegin(), header.rend(), '}').base() - header.begin();
+
+  header = make_npy_header(
+      std::string_view{header.data() + preamble_size,
+                       static_cast<size_t>(dict_end) - preamble_size},
+      new_size);
 }
 
-std::vector<char>
-cnpypp::create_npy_header(cnpypp::span<uint64_t const> const shape, char dtype,
-                          unsigned wordsize, MemoryOrder memory_order) {
-  std::vector<char> dict;
-  append(dict, "{'descr': '");
-  dict += BigEndianTest();
-  dict.push_back(dtype);
-  append(dict, std::to_string(wordsize));
-  append(dict, "', 'fortran_order': ");
-  append(dict, (memory_order == MemoryOrder::C) ? "False" : "True");
-  append(dict, ", 'shape': (");
-  append(dict, std::to_string(shape[0]));
-  for (size_t i = 1; i < shape.size(); i++) {
-    append(dict, ", ");
-    append(dict, std::to_string(shape[i]));
+// moves the byte range [begin, end) of a file by delta bytes towards its end
+static void shift_file_contents(std::fstream& fs, uint64_t begin, uint64_t end,
+                                uint64_t delta) {
+  size_t const chunk_size = 0x100000;
+  auto const chunk = std::make_unique<char[]>(chunk_size);
+
+  while (end > begin) {
+    auto const n =
+        static_cast<size_t>(std::min<uint64_t>(chunk_size, end - begin));
+    end -= n;
+    fs.seekg(end);
+    fs.read(chunk.get(), n);
+    fs.seekp(end + delta);
+    fs.write(chunk.get(), n);
   }
-  if (shape.size() == 1) {
-    append(dict, ",");
-  }
-  append(dict, "), }");
+}
 
-  // pad with spaces so that preamble+dict is modulo 16 bytes. preamble is 10
-  // bytes. dict needs to end with \n
-  int const remainder = 16 - (10 + dict.size()) % 16;
-  dict.insert(dict.end(), remainder, ' ');
-  dict.back() = '\n';
+size_t cnpypp::update_npy_header(std::fstream& fs, std::vector<char> header,
+                                 size_t header_size, uint64_t payload_bytes) {
+  if (header.size() > header_size) {
+    // header grew beyond its current size, payload needs to be moved
+    shift_file_contents(fs, header_size, header_size + payload_bytes,
+                        header.size() - header_size);
+  } else {
+    resize_npy_header(header, header_size);
+  }
 
-  std::vector<char> header;
-  header += (char)0x93;
-  append(header, "NUMPY");
-  header += (char)0x01; // major version of numpy format
-  header += (char)0x00; // minor version of numpy format
-  header += (uint16_t)dict.size();
-  header.insert(header.end(), dict.begin(), dict.end());
+  fs.seekp(0, std::ios_base::beg);
+  fs.write(header.data(), header.size());
 
-  return header;
+  return header.size();
 }
 
 // for C compatibility
@@ -779,10 +2164,8 @@ zip_int64_t cnpypp::detail::npzwrite_source_callback(void* userdata, void* data,
 #endif
 
 #ifndef NO_LIBZIP
-std::tuple<uint64_t, zip_t*>
-cnpypp::prepare_npz(std::string const& zipname,
-                    cnpypp::span<uint64_t const> const shape,
-                    std::string_view mode) {
+static zip_t* open_npz_for_writing(std::string const& zipname,
+                                   std::string_view mode) {
   int errcode = 0;
   zip_t* const archive = zip_open(
       zipname.c_str(), (mode == "w") ? (ZIP_CREATE | ZIP_TRUNCATE) : ZIP_CREATE,
@@ -792,6 +2175,14 @@ cnpypp::prepare_npz(std::string const& zipname,
     zip_error_init_with_code(&err, errcode);
     throw std::runtime_error(zip_error_strerror(&err));
   }
+  return archive;
+}
+
+std::tuple<uint64_t, zip_t*>
+cnpypp::prepare_npz(std::string const& zipname,
+                    cnpypp::span<uint64_t const> const shape,
+                    std::string_view mode) {
+  zip_t* const archive = open_npz_for_writing(zipname, mode);
 
   uint64_t const nels = std::accumulate(shape.begin(), shape.end(), uint64_t{1},
                                         std::multiplies<uint64_t>());
@@ -801,17 +2192,867 @@ cnpypp::prepare_npz(std::string const& zipname,
 #endif
 
 #ifndef NO_LIBZIP
-void cnpypp::finalize_npz(zip_t* archive, std::string fname,
-                          detail::additional_parameters& parameters,
-                          CompressionMethod compr_method) {
-  zip_source_t* source =
-      zip_source_function(archive, detail::npzwrite_source_callback,
-                          reinterpret_cast<void*>(&parameters));
+// uncompressed size of the blocks deflated concurrently (as in pigz)
+static size_t constexpr deflate_block_size = 0x20000;
+
+// size of the deflate window, i.e. of the dictionary a block is primed with
+static size_t constexpr deflate_dictionary_size = 0x8000;
+
+namespace {
+struct DeflatedBlock {
+  std::vector<unsigned char> data;
+  uLong crc;
+  size_t size;
+};
+
+// sizes and CRC of the data of a member
+struct MemberInfo {
+  uint64_t size = 0, compressed_size = 0;
+  uLong crc = crc32(0L, Z_NULL, 0);
+};
+
+// member data deflated concurrently and staged in a temporary file, which is
+// passed to libzip as already compressed data. owned by the zip source
+struct DeflatedMember {
+  std::unique_ptr<FILE, int (*)(FILE*)> file{std::tmpfile(), &std::fclose};
+  MemberInfo info;
+};
+} // namespace
+
+// compresses a block into a raw deflate stream, primed with the end of the
+// preceding block. all but the last block end with a sync flush, i.e. at a
+// byte boundary without the final-block bit, so that their concatenation is a
+// single valid deflate stream
+static DeflatedBlock deflate_block(std::vector<unsigned char> const& input,
+                                   std::vector<unsigned char> const& dictionary,
+                                   bool last) {
+  z_stream strm{};
+  // same level as used by libzip by default
+  if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw std::runtime_error("libcnpy++: could not initialize deflate");
+  }
+
+  if (!dictionary.empty()) {
+    deflateSetDictionary(&strm, dictionary.data(),
+                         static_cast<uInt>(dictionary.size()));
+  }
+
+  DeflatedBlock block{
+      std::vector<unsigned char>(deflateBound(&strm, input.size()) + 64),
+      crc32(crc32(0L, Z_NULL, 0), input.data(),
+            static_cast<uInt>(input.size())),
+      input.size()};
+
+  strm.next_in = const_cast<Bytef*>(input.data());
+  strm.avail_in = static_cast<uInt>(input.size());
+
+  int ret = Z_OK;
+  size_t produced = 0;
+  do {
+    if (produced == block.data.size()) {
+      block.data.resize(2 * block.data.size());
+    }
+    strm.next_out = block.data.data() + produced;
+    strm.avail_out = static_cast<uInt>(block.data.size() - produced);
+    ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+    produced = block.data.size() - strm.avail_out;
+  } while (ret != Z_STREAM_ERROR && strm.avail_out == 0);
+  deflateEnd(&strm);
+
+  if (ret == Z_STREAM_ERROR || (last && ret != Z_STREAM_END)) {
+    throw std::runtime_error("libcnpy++: deflate failed");
+  }
+
+  block.data.resize(produced);
+  return block;
+}
+
+// reads up to size bytes of the npy stream from the source callback. fewer
+// bytes are returned at the end of the data, but possibly also before if less
+// space is left than one element takes
+static std::vector<unsigned char>
+read_source(detail::additional_parameters& parameters, size_t size) {
+  std::vector<unsigned char> block(size);
+  size_t filled = 0;
+  while (filled < block.size()) {
+    auto const n = detail::npzwrite_source_callback(
+        &parameters, block.data() + filled, block.size() - filled,
+        ZIP_SOURCE_READ);
+    if (n <= 0) {
+      break;
+    }
+    filled += static_cast<size_t>(n);
+  }
+  block.resize(filled);
+  return block;
+}
+
+namespace {
+// deflates blocks on a fixed number of worker threads, which take the blocks
+// in the order they are submitted
+class DeflatePool {
+public:
+  explicit DeflatePool(unsigned num_threads) {
+    try {
+      for (unsigned i = 0; i < num_threads; ++i) {
+        workers.emplace_back([this]() { run(); });
+      }
+    } catch (...) {
+      close();
+      throw;
+    }
+  }
+  DeflatePool(DeflatePool const&) = delete;
+  ~DeflatePool() { close(); }
+
+  std::future<DeflatedBlock> submit(std::vector<unsigned char> block,
+                                    std::vector<unsigned char> dictionary,
+                                    bool last) {
+    Job job{std::move(block), std::move(dictionary), last, {}};
+    auto result = job.result.get_future();
+    {
+      std::lock_guard lock{mutex};
+      jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+    return result;
+  }
+
+private:
+  struct Job {
+    std::vector<unsigned char> block, dictionary;
+    bool last;
+    std::promise<DeflatedBlock> result;
+  };
+
+  void run() {
+    while (true) {
+      Job job;
+      {
+        std::unique_lock lock{mutex};
+        cv.wait(lock, [this]() { return closed || !jobs.empty(); });
+        if (closed) {
+          return; // jobs left over are abandoned
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      try {
+        job.result.set_value(
+            deflate_block(job.block, job.dictionary, job.last));
+      } catch (...) {
+        job.result.set_exception(std::current_exception());
+      }
+    }
+  }
+
+  void close() {
+    {
+      std::lock_guard lock{mutex};
+      closed = true;
+    }
+    cv.notify_all();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Job> jobs;
+  bool closed = false;
+  std::vector<std::thread> workers;
+};
+} // namespace
+
+// pulls the npy stream from the source callback block by block, deflates the
+// blocks on num_threads worker threads and passes them in order to write. at
+// most 2 * num_threads blocks are in memory at the same time
+template <typename Write>
+static MemberInfo
+deflate_concurrently(detail::additional_parameters& parameters,
+                     unsigned num_threads, Write const& write) {
+  MemberInfo info;
+  DeflatePool pool{num_threads};
+
+  std::deque<std::future<DeflatedBlock>> pending;
+  auto const write_oldest = [&pending, &info, &write]() {
+    auto const block = pending.front().get();
+    pending.pop_front();
+
+    write(block.data.data(), block.data.size());
+    info.crc =
+        crc32_combine(info.crc, block.crc, static_cast<z_off_t>(block.size));
+    info.size += block.size;
+    info.compressed_size += block.data.size();
+  };
+
+  std::vector<unsigned char> dictionary,
+      block = read_source(parameters, deflate_block_size);
+  for (bool last = false; !last;) {
+    // read ahead to know whether the current block is the last one. an empty
+    // block is only read at the end of the data
+    auto next = read_source(parameters, deflate_block_size);
+    last = next.empty();
+
+    std::vector<unsigned char> next_dictionary(
+        block.end() - std::min(block.size(), deflate_dictionary_size),
+        block.end());
+    pending.push_back(
+        pool.submit(std::move(block), std::move(dictionary), last));
+
+    dictionary = std::move(next_dictionary);
+    block = std::move(next);
+
+    if (pending.size() >= 2 * size_t{num_threads}) {
+      write_oldest();
+    }
+  }
+
+  while (!pending.empty()) {
+    write_oldest();
+  }
+
+  return info;
+}
+
+// deflates the npy stream into a single raw deflate stream on the calling
+// thread and passes the output to write as it is produced
+template <typename Write>
+static MemberInfo deflate_stream(detail::additional_parameters& parameters,
+                                 Write const& write) {
+  z_stream strm{};
+  if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw std::runtime_error("libcnpy++: could not initialize deflate");
+  }
+  // also ends the stream if reading or writing throws
+  std::unique_ptr<z_stream, int (*)(z_stream*)> const guard{&strm,
+                                                            &deflateEnd};
+
+  MemberInfo info;
+  std::vector<unsigned char> output(deflate_block_size);
+  int ret = Z_OK;
+  for (bool last = false; !last;) {
+    auto const input = read_source(parameters, deflate_block_size);
+    last = input.empty();
+    info.crc = crc32(info.crc, input.data(), static_cast<uInt>(input.size()));
+    info.size += input.size();
+
+    strm.next_in = const_cast<Bytef*>(input.data());
+    strm.avail_in = static_cast<uInt>(input.size());
+    do {
+      strm.next_out = output.data();
+      strm.avail_out = static_cast<uInt>(output.size());
+      ret = deflate(&strm, last ? Z_FINISH : Z_NO_FLUSH);
+      if (ret == Z_STREAM_ERROR) {
+        throw std::runtime_error("libcnpy++: deflate failed");
+      }
+      auto const n = output.size() - strm.avail_out;
+      write(output.data(), n);
+      info.compressed_size += n;
+    } while (strm.avail_out == 0);
+  }
+
+  if (ret != Z_STREAM_END) {
+    throw std::runtime_error("libcnpy++: deflate failed");
+  }
+  return info;
+}
+
+// deflates the data concurrently into a temporary file
+static DeflatedMember
+deflate_to_tmpfile(detail::additional_parameters& parameters,
+                   unsigned num_threads) {
+  DeflatedMember member;
+  if (!member.file) {
+    throw std::runtime_error("libcnpy++: could not create temporary file");
+  }
+
+  member.info = deflate_concurrently(
+      parameters, num_threads, [&member](unsigned char const* data, size_t n) {
+        if (std::fwrite(data, 1, n, member.file.get()) != n) {
+          throw std::runtime_error("libcnpy++: could not write temporary file");
+        }
+      });
+
+  return member;
+}
+
+static zip_int64_t deflated_source_callback(void* userdata, void* data,
+                                            zip_uint64_t length,
+                                            zip_source_cmd_t cmd) {
+  auto* const member = reinterpret_cast<DeflatedMember*>(userdata);
+
+  switch (cmd) {
+  case ZIP_SOURCE_OPEN:
+    std::rewind(member->file.get());
+    return 0;
+
+  case ZIP_SOURCE_READ: {
+    auto const n = std::fread(data, 1, length, member->file.get());
+    return std::ferror(member->file.get()) ? -1 : static_cast<zip_int64_t>(n);
+  }
+
+  case ZIP_SOURCE_STAT: {
+    // sizes, CRC and method make libzip copy the data without recompressing
+    zip_stat_t* stat = reinterpret_cast<zip_stat_t*>(data);
+    zip_stat_init(stat);
+    stat->valid |= ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD |
+                   ZIP_STAT_CRC;
+    stat->size = member->info.size;
+    stat->comp_size = member->info.compressed_size;
+    stat->comp_method = ZIP_CM_DEFLATE;
+    stat->crc = static_cast<zip_uint32_t>(member->info.crc);
+    return sizeof(zip_stat_t);
+  }
+
+  case ZIP_SOURCE_SUPPORTS:
+    return zip_source_make_command_bitmap(
+        ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT,
+        ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+
+  case ZIP_SOURCE_FREE:
+    delete member;
+    return 0;
+
+  default:
+    return 0;
+  }
+}
+
+// MS-DOS time and date of the zip headers
+static std::pair<uint16_t, uint16_t> dos_time_date(std::time_t time) {
+  std::tm tm{};
+#if defined(_WIN32)
+  localtime_s(&tm, &time);
+#else
+  localtime_r(&time, &tm);
+#endif
+  if (tm.tm_year < 80) {
+    return {0, (1 << 5) | 1}; // 1980-01-01, earliest representable date
+  }
+  return {static_cast<uint16_t>((tm.tm_hour << 11) | (tm.tm_min << 5) |
+                                (tm.tm_sec / 2)),
+          static_cast<uint16_t>(((tm.tm_year - 80) << 9) |
+                                ((tm.tm_mon + 1) << 5) | tm.tm_mday)};
+}
+
+// appends the array to an existing archive in time proportional to its size,
+// unlike libzip, which writes a complete copy of the archive: the local header
+// and data are written over the central directory, which is then written anew
+// including the new entry (with zip64 records if necessary). on failure, the
+// old central directory is restored. returns false without modifying the
+// archive if it does not exist or cannot be parsed, if it already contains an
+// entry of this name or if the compression method is neither Store nor
+// Deflate. data_size is the size of the npy stream
+static bool append_npz_member(std::string const& zipname, std::string fname,
+                              detail::additional_parameters& parameters,
+                              uint64_t data_size,
+                              CompressionMethod compr_method,
+                              unsigned num_threads) {
+  if ((compr_method != CompressionMethod::Store &&
+       compr_method != CompressionMethod::Deflate) ||
+      !boost::filesystem::exists(zipname)) {
+    return false;
+  }
+
+  std::fstream fs{zipname, std::ios::binary | std::ios::in | std::ios::out};
+  fs.seekg(0, std::ios::end);
+  uint64_t const file_size = fs.tellg();
+  if (!fs || file_size == 0) {
+    return false;
+  }
+
+  std::optional<CentralDirectory> directory;
+  try {
+    directory.emplace(read_central_directory(fs));
+  } catch (std::runtime_error const&) {
+    return false; // left to libzip
+  }
+
+  fname += ".npy";
+  if (zip_local_header_offsets(*directory).count(fname) != 0) {
+    return false;
+  }
+
+  // everything from the central directory on, restored on failure
+  std::vector<char> old_tail(file_size - directory->offset);
+  fs.seekg(directory->offset);
+  fs.read(old_tail.data(), old_tail.size());
+  if (!fs) {
+    return false;
+  }
+
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  uint64_t const local_offset = directory->offset;
+  // the compressed size may slightly exceed data_size
+  bool const zip64_sizes = data_size >= 0xf0000000;
+  bool const zip64_offset = local_offset >= 0xffffffff;
+  uint16_t const version = (zip64_sizes || zip64_offset) ? 45 : 20;
+  uint16_t const method = compr_method == CompressionMethod::Store
+                              ? ZIP_CM_STORE
+                              : ZIP_CM_DEFLATE;
+  // UTF-8 names are flagged as such
+  uint16_t const flags =
+      std::any_of(fname.cbegin(), fname.cend(),
+                  [](char c) { return static_cast<unsigned char>(c) >= 0x80; })
+          ? 0x0800
+          : 0;
+  auto const [dos_time, dos_date] = dos_time_date(std::time(nullptr));
+
+  // CRC and sizes are filled in after the data are written
+  std::vector<char> local;
+  append_le<uint32_t>(local, 0x04034b50);
+  append_le<uint16_t>(local, zip64_sizes ? 45 : 20);
+  append_le<uint16_t>(local, flags);
+  append_le<uint16_t>(local, method);
+  append_le<uint16_t>(local, dos_time);
+  append_le<uint16_t>(local, dos_date);
+  append_le<uint32_t>(local, 0);
+  append_le<uint32_t>(local, zip64_sizes ? 0xffffffff : 0);
+  append_le<uint32_t>(local, zip64_sizes ? 0xffffffff : 0);
+  append_le<uint16_t>(local, static_cast<uint16_t>(fname.size()));
+  append_le<uint16_t>(local, zip64_sizes ? 20 : 0);
+  local.insert(local.end(), fname.cbegin(), fname.cend());
+  if (zip64_sizes) {
+    append_le<uint16_t>(local, 0x0001);
+    append_le<uint16_t>(local, 16);
+    append_le<uint64_t>(local, 0);
+    append_le<uint64_t>(local, 0);
+  }
+
+  try {
+    fs.seekp(local_offset);
+    fs.write(local.data(), local.size());
+
+    auto const write = [&fs](unsigned char const* data, size_t n) {
+      fs.write(reinterpret_cast<char const*>(data), n);
+    };
+
+    MemberInfo info;
+    if (compr_method == CompressionMethod::Deflate) {
+      info = num_threads > 1
+                 ? deflate_concurrently(parameters, num_threads, write)
+                 : deflate_stream(parameters, write);
+    } else {
+      while (true) {
+        auto const block = read_source(parameters, deflate_block_size);
+        if (block.empty()) {
+          break;
+        }
+        write(block.data(), block.size());
+        info.crc =
+            crc32(info.crc, block.data(), static_cast<uInt>(block.size()));
+        info.size += block.size();
+        info.compressed_size += block.size();
+      }
+    }
+
+    if (!zip64_sizes &&
+        std::max(info.size, info.compressed_size) >= 0xffffffff) {
+      throw std::runtime_error("libcnpy++: unexpected size of zip entry");
+    }
+
+    store_le<uint32_t>(&local[14], static_cast<uint32_t>(info.crc));
+    if (zip64_sizes) {
+      store_le<uint64_t>(&local[34 + fname.size()], info.size);
+      store_le<uint64_t>(&local[42 + fname.size()], info.compressed_size);
+    } else {
+      store_le<uint32_t>(&local[18],
+                         static_cast<uint32_t>(info.compressed_size));
+      store_le<uint32_t>(&local[22], static_cast<uint32_t>(info.size));
+    }
+    fs.seekp(local_offset);
+    fs.write(local.data(), local.size());
+
+    // central directory: the old entries followed by the new one
+    std::vector<char> dir = std::move(directory->records);
+    uint16_t const zip64_extra_size = 8 * (2 * zip64_sizes + zip64_offset);
+    append_le<uint32_t>(dir, 0x02014b50);
+    append_le<uint16_t>(dir, (3 << 8) | version); // made by: UNIX
+    append_le<uint16_t>(dir, version);
+    append_le<uint16_t>(dir, flags);
+    append_le<uint16_t>(dir, method);
+    append_le<uint16_t>(dir, dos_time);
+    append_le<uint16_t>(dir, dos_date);
+    append_le<uint32_t>(dir, static_cast<uint32_t>(info.crc));
+    append_le<uint32_t>(dir, zip64_sizes
+                                 ? 0xffffffff
+                                 : static_cast<uint32_t>(info.compressed_size));
+    append_le<uint32_t>(
+        dir, zip64_sizes ? 0xffffffff : static_cast<uint32_t>(info.size));
+    append_le<uint16_t>(dir, static_cast<uint16_t>(fname.size()));
+    append_le<uint16_t>(dir, zip64_extra_size ? 4 + zip64_extra_size : 0);
+    append_le<uint16_t>(dir, 0);              // comment length
+    append_le<uint16_t>(dir, 0);              // disk number
+    append_le<uint16_t>(dir, 0);              // internal attributes
+    append_le<uint32_t>(dir, 0100644u << 16); // external attributes
+    append_le<uint32_t>(
+        dir, zip64_offset ? 0xffffffff : static_cast<uint32_t>(local_offset));
+    dir.insert(dir.end(), fname.cbegin(), fname.cend());
+    if (zip64_extra_size) {
+      append_le<uint16_t>(dir, 0x0001);
+      append_le<uint16_t>(dir, zip64_extra_size);
+      if (zip64_sizes) {
+        append_le<uint64_t>(dir, info.size);
+        append_le<uint64_t>(dir, info.compressed_size);
+      }
+      if (zip64_offset) {
+        append_le<uint64_t>(dir, local_offset);
+      }
+    }
+
+    uint64_t const num_entries = directory->num_entries + 1;
+    uint64_t const dir_offset =
+        local_offset + local.size() + info.compressed_size;
+    uint64_t const dir_size = dir.size();
+
+    if (num_entries >= 0xffff || dir_size >= 0xffffffff ||
+        dir_offset >= 0xffffffff) {
+      // zip64 end of central directory record and locator
+      append_le<uint32_t>(dir, 0x06064b50);
+      append_le<uint64_t>(dir, 44);
+      append_le<uint16_t>(dir, (3 << 8) | 45);
+      append_le<uint16_t>(dir, 45);
+      append_le<uint32_t>(dir, 0);
+      append_le<uint32_t>(dir, 0);
+      append_le<uint64_t>(dir, num_entries);
+      append_le<uint64_t>(dir, num_entries);
+      append_le<uint64_t>(dir, dir_size);
+      append_le<uint64_t>(dir, dir_offset);
+
+      append_le<uint32_t>(dir, 0x07064b50);
+      append_le<uint32_t>(dir, 0);
+      append_le<uint64_t>(dir, dir_offset + dir_size);
+      append_le<uint32_t>(dir, 1);
+    }
+
+    append_le<uint32_t>(dir, 0x06054b50);
+    append_le<uint16_t>(dir, 0);
+    append_le<uint16_t>(dir, 0);
+    append_le<uint16_t>(
+        dir, static_cast<uint16_t>(std::min<uint64_t>(num_entries, 0xffff)));
+    append_le<uint16_t>(
+        dir, static_cast<uint16_t>(std::min<uint64_t>(num_entries, 0xffff)));
+    append_le<uint32_t>(
+        dir, static_cast<uint32_t>(std::min<uint64_t>(dir_size, 0xffffffff)));
+    append_le<uint32_t>(
+        dir, static_cast<uint32_t>(std::min<uint64_t>(dir_offset, 0xffffffff)));
+    append_le<uint16_t>(dir, static_cast<uint16_t>(directory->comment.size()));
+    dir.insert(dir.end(), directory->comment.cbegin(),
+               directory->comment.cend());
+
+    fs.seekp(dir_offset);
+    fs.write(dir.data(), dir.size());
+    fs.flush();
+    if (!fs) {
+      throw std::runtime_error("libcnpy++: could not write " + zipname);
+    }
+  } catch (...) {
+    fs.clear();
+    fs.seekp(directory->offset);
+    fs.write(old_tail.data(), old_tail.size());
+    fs.close();
+    boost::system::error_code ec;
+    boost::filesystem::resize_file(zipname, file_size, ec);
+    throw;
+  }
+
+  return true;
+}
 
+// adds the array to the archive; its data are read by zip_close(), except for
+// arrays deflated concurrently, which are compressed right away
+static void add_npz_member(zip_t* archive, std::string fname,
+                           detail::additional_parameters& parameters,
+                           CompressionMethod compr_method,
+                           unsigned num_threads) {
   fname += ".npy";
+
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  bool const concurrent =
+      compr_method == CompressionMethod::Deflate && num_threads > 1;
+
+  zip_source_t* source = nullptr;
+  if (concurrent) {
+    auto member = std::make_unique<DeflatedMember>(
+        deflate_to_tmpfile(parameters, num_threads));
+    source = zip_source_function(archive, deflated_source_callback,
+                                 member.get());
+    if (source) {
+      member.release(); // owned by the source from now on and freed with it
+    }
+  } else {
+    source = zip_source_function(archive, detail::npzwrite_source_callback,
+                                 reinterpret_cast<void*>(&parameters));
+  }
+  if (!source) {
+    throw std::runtime_error(zip_strerror(archive));
+  }
+
   auto const index = zip_file_add(archive, fname.c_str(), source,
                                   ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
-  zip_set_file_compression(archive, index, static_cast<int>(compr_method), 0);
+  if (index < 0) {
+    zip_source_free(source);
+    throw std::runtime_error(zip_strerror(archive));
+  }
+
+  // already deflated data are copied as they are
+  if (!concurrent) {
+    zip_set_file_compression(archive, index, static_cast<int>(compr_method),
+                             0);
+  }
+}
+
+void cnpypp::finalize_npz(zip_t* archive, std::string fname,
+                          detail::additional_parameters& parameters,
+                          CompressionMethod compr_method,
+                          unsigned num_threads) {
+  try {
+    add_npz_member(archive, std::move(fname), parameters, compr_method,
+                   num_threads);
+  } catch (...) {
+    zip_discard(archive);
+    throw;
+  }
   zip_close(archive);
 }
+
+void cnpypp::save_npz(std::string const& zipname, std::string const& fname,
+                      detail::additional_parameters& parameters,
+                      cnpypp::span<uint64_t const> const shape,
+                      std::string_view mode, CompressionMethod compr_method,
+                      unsigned num_threads) {
+  if (mode != "w") {
+    uint64_t const nels =
+        std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                        std::multiplies<uint64_t>());
+    if (append_npz_member(zipname, fname, parameters,
+                          parameters.npyheader.size() +
+                              nels * parameters.buffer_capacity,
+                          compr_method, num_threads)) {
+      return;
+    }
+  }
+
+  auto const archive = std::get<1>(prepare_npz(zipname, shape, mode));
+  finalize_npz(archive, fname, parameters, compr_method, num_threads);
+}
+
+cnpypp::NpzWriter::NpzWriter(std::string const& _zipname,
+                             std::string_view mode)
+    : zipname{_zipname}, archive{open_npz_for_writing(_zipname, mode),
+                                 zip_discard} {}
+
+cnpypp::NpzWriter::~NpzWriter() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+void cnpypp::NpzWriter::add_source(
+    std::string fname,
+    std::unique_ptr<detail::additional_parameters> parameters,
+    CompressionMethod compr_method, unsigned num_threads) {
+  if (!archive) {
+    throw std::runtime_error("NpzWriter: archive already closed");
+  }
+
+  // stored before libzip refers to them, so that storing them cannot fail
+  // afterwards and leave libzip with a dangling pointer
+  sources.push_back(std::move(parameters));
+  try {
+    add_npz_member(archive.get(), std::move(fname), *sources.back(),
+                   compr_method, num_threads);
+  } catch (...) {
+    sources.pop_back();
+    throw;
+  }
+}
+
+void cnpypp::NpzWriter::close() {
+  if (!archive) {
+    return;
+  }
+
+  zip_t* const z = archive.release();
+  if (zip_close(z) != 0) {
+    std::stringstream ss;
+    ss << "NpzWriter: could not write " << std::quoted(zipname) << ": "
+       << zip_strerror(z);
+    zip_discard(z);
+    sources.clear();
+    throw std::runtime_error{ss.str()};
+  }
+  sources.clear();
+}
 #endif
+
+cnpypp::NpyAppenderBase::NpyAppenderBase(
+    std::string const& fname, cnpypp::span<uint64_t const> _row_shape,
+    std::vector<std::string> _labels, std::vector<char> _dtypes,
+    std::vector<size_t> _sizes, std::string_view mode,
+    MemoryOrder _memory_order, size_t buffer_size, size_t _header_capacity,
+    size_t _data_alignment)
+    : row_shape{_row_shape.begin(), _row_shape.end()},
+      labels{std::move(_labels)}, dtypes{std::move(_dtypes)},
+      sizes{std::move(_sizes)}, memory_order{_memory_order},
+      row_elements{std::accumulate(row_shape.begin(), row_shape.end(),
+                                   uint64_t{1}, std::multiplies<uint64_t>{})},
+      row_bytes{row_elements * std::accumulate(sizes.begin(), sizes.end(),
+                                               uint64_t{0})},
+      header_capacity{_header_capacity}, data_alignment{_data_alignment},
+      buffer_capacity{buffer_size}, buffer{std::make_unique<char[]>(
+                                        buffer_size)} {
+  if (row_bytes == 0) {
+    throw std::runtime_error("NpyAppender: empty rows not supported");
+  }
+
+  if (mode == "a" && _exists(fname)) {
+    fs.open(fname,
+            std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+    if (!fs) {
+      throw std::runtime_error("NpyAppender: unable to open file " + fname);
+    }
+
+    std::vector<unsigned> word_sizes_exist;
+    std::vector<char> data_types_exist;
+    std::vector<std::string> labels_exist;
+    std::vector<uint64_t> shape_exist;
+    MemoryOrder memory_order_exist;
+
+    parse_npy_header(fs, word_sizes_exist, data_types_exist, labels_exist,
+                     shape_exist, memory_order_exist);
+
+    if (!std::equal(word_sizes_exist.cbegin(), word_sizes_exist.cend(),
+                    sizes.cbegin(), sizes.cend())) {
+      throw std::runtime_error{
+          "NpyAppender: appending failed: element sizes not matching"};
+    } else if (data_types_exist != dtypes) {
+      throw std::runtime_error{"NpyAppender: appending failed: data type "
+                               "descriptors not matching"};
+    } else if (labels_exist != labels) {
+      throw std::runtime_error{
+          "NpyAppender: appending failed: labels not matching"};
+    } else if (memory_order_exist != memory_order) {
+      throw std::runtime_error{
+          "NpyAppender: appending failed: memory order does not match"};
+    } else if (shape_exist.size() != row_shape.size() + 1) {
+      throw std::runtime_error{"NpyAppender: appending failed: ranks not "
+                               "matching"};
+    }
+
+    bool const row_shape_matches =
+        (memory_order == MemoryOrder::C)
+            ? std::equal(std::next(shape_exist.cbegin()), shape_exist.cend(),
+                         row_shape.cbegin())
+            : std::equal(shape_exist.cbegin(), std::prev(shape_exist.cend()),
+                         row_shape.cbegin());
+    if (!row_shape_matches) {
+      std::stringstream ss;
+      ss << "NpyAppender: attempting to append misshaped data to "
+         << std::quoted(fname);
+      throw std::runtime_error{ss.str().c_str()};
+    }
+
+    header_size = fs.tellg();
+    fs.seekp(0, std::ios_base::end);
+    payload_bytes = static_cast<uint64_t>(fs.tellp()) - header_size;
+
+    if (payload_bytes % row_bytes != 0) {
+      throw std::runtime_error{
+          "NpyAppender: appending failed: file size inconsistent with header"};
+    }
+  } else {
+    fs.open(fname, std::ios_base::binary | std::ios_base::in |
+                       std::ios_base::out | std::ios_base::trunc);
+    if (!fs) {
+      throw std::runtime_error("NpyAppender: unable to open file " + fname);
+    }
+
+    auto const header = create_header();
+    fs.write(header.data(), header.size());
+    header_size = header.size();
+  }
+}
+
+cnpypp::NpyAppenderBase::~NpyAppenderBase() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+std::vector<char> cnpypp::NpyAppenderBase::create_header() const {
+  std::vector<uint64_t> shape;
+  shape.reserve(row_shape.size() + 1);
+  if (memory_order == MemoryOrder::C) {
+    shape.push_back(rows());
+  }
+  shape.insert(shape.end(), row_shape.cbegin(), row_shape.cend());
+  if (memory_order == MemoryOrder::Fortran) {
+    shape.push_back(rows());
+  }
+
+  if (labels.empty()) {
+    return create_npy_header(shape, dtypes.at(0), sizes.at(0), memory_order,
+                             header_capacity, data_alignment);
+  } else {
+    std::vector<std::string_view> const label_views{labels.cbegin(),
+                                                    labels.cend()};
+    return create_npy_header(shape, label_views, dtypes, sizes, memory_order,
+                             header_capacity, data_alignment);
+  }
+}
+
+void cnpypp::NpyAppenderBase::write_buffer() {
+  fs.seekp(0, std::ios_base::end);
+  fs.write(buffer.get(), buffer_used);
+  payload_bytes += buffer_used;
+  buffer_used = 0;
+}
+
+void cnpypp::NpyAppenderBase::append_bytes(char const* data,
+                                           size_t num_bytes) {
+  if (num_bytes > buffer_capacity - buffer_used) {
+    write_buffer();
+  }
+
+  if (num_bytes >= buffer_capacity) {
+    // too large to be buffered, bypass the buffer
+    write_buffer();
+    fs.write(data, num_bytes);
+    payload_bytes += num_bytes;
+  } else {
+    std::copy_n(data, num_bytes, &buffer[buffer_used]);
+    buffer_used += num_bytes;
+  }
+}
+
+void cnpypp::NpyAppenderBase::flush() {
+  write_buffer();
+
+  header_size = update_npy_header(fs, create_header(), header_size,
+                                  payload_bytes);
+  fs.flush();
+
+  if (!fs) {
+    throw std::runtime_error("NpyAppender: writing to file failed");
+  }
+}
+
+void cnpypp::NpyAppenderBase::close() {
+  if (fs.is_open()) {
+    flush();
+    fs.close();
+  }
+}
@@ -0,0 +1,513 @@
+// Copyright (C) 2023 Maximilian Reininghaus
+// Released under MIT License
+// license available in LICENSE file, or at
+// http://www.opensource.org/licenses/mit-license.php
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <liburing.h>
+
+#include "cnpy++.hpp"
+
+using namespace cnpypp;
+
+namespace {
+// bytes read at first to obtain the header, usually all of it
+size_t constexpr initial_header_read = 0x1000;
+
+struct Request;
+
+// a single read or write, resubmitted with the remainder after partial
+// completion
+struct Operation {
+  Request* request;
+  std::byte* ptr;
+  size_t size;
+  uint64_t pos;
+  bool write;
+  bool allow_short; // for reading the header of files smaller than expected
+};
+
+struct Request {
+  enum class Phase { Header, Data };
+
+  std::string fname;
+  int fd = -1;
+  Phase phase = Phase::Header;
+  unsigned pending_operations = 0;
+  std::exception_ptr error;
+  bool finished = false; // result delivered
+
+  // load
+  BufferAllocator allocator;
+  std::promise<NpyArray> load_result;
+  std::vector<char> header;
+  size_t header_bytes = 0;
+  std::vector<uint64_t> shape;
+  std::vector<unsigned> word_sizes;
+  std::vector<std::string> labels;
+  MemoryOrder memory_order = MemoryOrder::C;
+  std::unique_ptr<Buffer> buffer;
+
+  // save
+  cnpypp::span<std::byte const> data;
+  std::promise<void> save_result;
+  bool is_save = false;
+};
+} // namespace
+
+struct cnpypp::UringIO::Impl {
+  io_uring ring;
+  unsigned const queue_depth;
+  size_t const chunk_size;
+  std::vector<cnpypp::span<std::byte>> registered_buffers;
+
+  std::vector<std::unique_ptr<Request>> requests; // queued, not started
+  std::vector<std::unique_ptr<Request>> started;
+  std::deque<Operation> queued_operations;
+  unsigned in_flight = 0;
+  std::exception_ptr ring_error; // the ring is unusable after it
+
+  void start(Request& request);
+  void enqueue(Operation operation);
+  void submit();
+  void complete(Operation& operation, int result);
+  void process_header(Request& request);
+  void finish(Request& request);
+  void fail(std::exception_ptr error);
+  int registered_index(std::byte const* ptr, size_t size) const;
+};
+
+cnpypp::UringIO::UringIO(unsigned queue_depth, size_t chunk_size)
+    : impl{new Impl{
+          {}, std::max(queue_depth, 1u), chunk_size, {}, {}, {}, {}, 0, {}}} {
+  if (chunk_size == 0) {
+    throw std::runtime_error("UringIO: chunk_size must not be 0");
+  }
+  if (int const err = io_uring_queue_init(impl->queue_depth, &impl->ring, 0);
+      err < 0) {
+    throw std::runtime_error(std::string{"UringIO: io_uring_queue_init(): "} +
+                             std::strerror(-err));
+  }
+}
+
+// requests that were not waited for are abandoned, their futures report
+// std::future_error. operations left in flight by a failed wait() are reaped
+// if possible, before their requests are destroyed
+cnpypp::UringIO::~UringIO() {
+  io_uring_cqe* cqe;
+  while (impl->in_flight > 0 && io_uring_wait_cqe(&impl->ring, &cqe) == 0) {
+    delete static_cast<Operation*>(io_uring_cqe_get_data(cqe));
+    io_uring_cqe_seen(&impl->ring, cqe);
+    --impl->in_flight;
+  }
+  io_uring_queue_exit(&impl->ring);
+}
+
+void cnpypp::UringIO::register_buffers(
+    std::vector<cnpypp::span<std::byte>> const& buffers) {
+  if (!impl->registered_buffers.empty()) {
+    io_uring_unregister_buffers(&impl->ring);
+    impl->registered_buffers.clear();
+  }
+
+  if (buffers.empty()) {
+    return;
+  }
+
+  std::vector<iovec> iovecs;
+  iovecs.reserve(buffers.size());
+  for (auto const& b : buffers) {
+    iovecs.push_back(iovec{b.data(), b.size()});
+  }
+
+  if (int const err = io_uring_register_buffers(&impl->ring, iovecs.data(),
+                                                iovecs.size());
+      err < 0) {
+    throw std::runtime_error(
+        std::string{"UringIO: io_uring_register_buffers(): "} +
+        std::strerror(-err));
+  }
+  impl->registered_buffers = buffers;
+}
+
+std::future<NpyArray> cnpypp::UringIO::load(std::string fname,
+                                             BufferAllocator allocator) {
+  auto request = std::make_unique<Request>();
+  request->fname = std::move(fname);
+  request->allocator = std::move(allocator);
+  auto future = request->load_result.get_future();
+  impl->requests.push_back(std::move(request));
+  return future;
+}
+
+std::future<NpyArray>
+cnpypp::UringIO::load_into(std::string fname, cnpypp::span<std::byte> dest) {
+  return load(std::move(fname),
+              [dest](size_t size, size_t) -> std::unique_ptr<Buffer> {
+                if (size > dest.size()) {
+                  throw std::runtime_error(
+                      "UringIO::load_into: destination too small");
+                }
+                return std::make_unique<ExternalBuffer>(dest.data());
+              });
+}
+
+std::future<void> cnpypp::UringIO::save(std::string fname,
+                                        std::vector<char> header,
+                                        cnpypp::span<std::byte const> data) {
+  auto request = std::make_unique<Request>();
+  request->fname = std::move(fname);
+  request->header = std::move(header);
+  request->data = data;
+  request->is_save = true;
+  auto future = request->save_result.get_future();
+  impl->requests.push_back(std::move(request));
+  return future;
+}
+
+void cnpypp::UringIO::wait() {
+  // moved out first, so that no request is started twice
+  auto requests = std::move(impl->requests);
+  impl->requests.clear();
+
+  if (impl->ring_error) {
+    for (auto& request : requests) {
+      request->error = impl->ring_error;
+      impl->finish(*request);
+    }
+    return;
+  }
+
+  impl->started = std::move(requests); // empty without a ring error
+
+  try {
+    for (auto& request : impl->started) {
+      impl->start(*request);
+    }
+
+    while (!impl->queued_operations.empty() || impl->in_flight > 0) {
+      impl->submit();
+      if (impl->in_flight == 0) { // only operations of failed requests left
+        continue;
+      }
+
+      io_uring_cqe* cqe;
+      if (int const err = io_uring_wait_cqe(&impl->ring, &cqe); err < 0) {
+        if (err == -EINTR) {
+          continue;
+        }
+        throw std::runtime_error(
+            std::string{"UringIO: io_uring_wait_cqe(): "} +
+            std::strerror(-err));
+      }
+
+      // reap everything available without waiting again
+      do {
+        auto* const operation =
+            static_cast<Operation*>(io_uring_cqe_get_data(cqe));
+        int const result = cqe->res;
+        io_uring_cqe_seen(&impl->ring, cqe);
+        --impl->in_flight;
+        impl->complete(*operation, result);
+        delete operation;
+      } while (io_uring_peek_cqe(&impl->ring, &cqe) == 0);
+    }
+  } catch (...) {
+    impl->fail(std::current_exception());
+    throw;
+  }
+
+  impl->started.clear();
+}
+
+void cnpypp::UringIO::Impl::start(Request& request) {
+  int const flags =
+      request.is_save ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY;
+  request.fd = ::open(request.fname.c_str(), flags | O_CLOEXEC, 0644);
+
+  if (request.fd == -1) {
+    request.error = std::make_exception_ptr(
+        std::runtime_error("UringIO: Unable to open file " + request.fname));
+    finish(request);
+  } else if (request.is_save) {
+    request.phase = Request::Phase::Data;
+    enqueue({&request, reinterpret_cast<std::byte*>(request.header.data()),
+             request.header.size(), 0, true, false});
+
+    auto* const data = const_cast<std::byte*>(request.data.data());
+    for (uint64_t pos = 0; pos < request.data.size(); pos += chunk_size) {
+      enqueue({&request, data + pos,
+               static_cast<size_t>(std::min<uint64_t>(
+                   chunk_size, request.data.size() - pos)),
+               request.header.size() + pos, true, false});
+    }
+  } else {
+    request.header.resize(initial_header_read);
+    enqueue({&request, reinterpret_cast<std::byte*>(request.header.data()),
+             request.header.size(), 0, false, true});
+  }
+}
+
+void cnpypp::UringIO::Impl::enqueue(Operation operation) {
+  ++operation.request->pending_operations;
+  queued_operations.push_back(operation);
+}
+
+int cnpypp::UringIO::Impl::registered_index(std::byte const* ptr,
+                                            size_t size) const {
+  for (size_t i = 0; i < registered_buffers.size(); ++i) {
+    auto const& b = registered_buffers[i];
+    if (ptr >= b.data() && ptr + size <= b.data() + b.size()) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+void cnpypp::UringIO::Impl::submit() {
+  while (!queued_operations.empty() && in_flight < queue_depth) {
+    Operation& front = queued_operations.front();
+
+    if (front.request->error) { // request failed already, skip the rest
+      Request& request = *front.request;
+      queued_operations.pop_front();
+      if (--request.pending_operations == 0) {
+        finish(request);
+      }
+      continue;
+    }
+
+    io_uring_sqe* const sqe = io_uring_get_sqe(&ring);
+    if (!sqe) {
+      break;
+    }
+
+    auto* const operation = new Operation{front};
+    queued_operations.pop_front();
+
+    // single operations are limited to (a bit less than) 2 GiB by the kernel
+    auto const size =
+        static_cast<unsigned>(std::min<size_t>(operation->size, 0x40000000));
+
+    if (int const index = registered_index(operation->ptr, size);
+        index >= 0) {
+      if (operation->write) {
+        io_uring_prep_write_fixed(sqe, operation->request->fd, operation->ptr,
+                                  size, operation->pos, index);
+      } else {
+        io_uring_prep_read_fixed(sqe, operation->request->fd, operation->ptr,
+                                 size, operation->pos, index);
+      }
+    } else if (operation->write) {
+      io_uring_prep_write(sqe, operation->request->fd, operation->ptr, size,
+                          operation->pos);
+    } else {
+      io_uring_prep_read(sqe, operation->request->fd, operation->ptr, size,
+                         operation->pos);
+    }
+
+    io_uring_sqe_set_data(sqe, operation);
+    ++in_flight;
+  }
+
+  if (int const err = io_uring_submit(&ring); err < 0 && err != -EINTR) {
+    throw std::runtime_error(std::string{"UringIO: io_uring_submit(): "} +
+                             std::strerror(-err));
+  }
+}
+
+void cnpypp::UringIO::Impl::complete(Operation& operation, int result) {
+  Request& request = *operation.request;
+
+  if (result == -EAGAIN || result == -EINTR) {
+    queued_operations.push_back(operation); // retry, still pending
+    return;
+  } else if (result < 0) {
+    if (!request.error) {
+      request.error = std::make_exception_ptr(std::runtime_error(
+          "UringIO: I/O error on " + request.fname + ": " +
+          std::strerror(-result)));
+    }
+  } else if (static_cast<size_t>(result) < operation.size &&
+             !operation.allow_short) {
+    if (result == 0) { // end of file
+      if (!request.error) {
+        request.error = std::make_exception_ptr(
+            std::runtime_error("UringIO: file truncated " + request.fname));
+      }
+    } else {
+      operation.ptr += result;
+      operation.size -= result;
+      operation.pos += result;
+      queued_operations.push_back(operation);
+      return;
+    }
+  } else if (request.phase == Request::Phase::Header) {
+    request.header_bytes = operation.pos + result;
+  }
+
+  if (--request.pending_operations == 0) {
+    if (request.phase == Request::Phase::Header && !request.error) {
+      process_header(request);
+    } else {
+      finish(request);
+    }
+  }
+}
+
+void cnpypp::UringIO::Impl::process_header(Request& request) {
+  try {
+    if (request.header_bytes < 12) {
+      throw std::runtime_error("UringIO: header truncated " + request.fname);
+    }
+
+    size_t const header_size = npy_header_size(request.header.data());
+    if (header_size > request.header_bytes) { // read the rest of the header
+      request.header.resize(header_size);
+      enqueue({&request,
+               reinterpret_cast<std::byte*>(request.header.data()) +
+                   request.header_bytes,
+               header_size - request.header_bytes, request.header_bytes,
+               false, false});
+      return;
+    }
+
+    std::vector<char> data_types;
+    parse_npy_header(request.header.data(), request.word_sizes, data_types,
+                     request.labels, request.shape, request.memory_order);
+
+    auto const num_vals =
+        std::accumulate(request.shape.begin(), request.shape.end(),
+                        uint64_t{1}, std::multiplies<uint64_t>());
+    auto const total_value_size =
+        std::accumulate(request.word_sizes.begin(), request.word_sizes.end(),
+                        0u, std::plus<unsigned>());
+    uint64_t const num_bytes = total_value_size * num_vals;
+
+    // same alignment as the data in the file, as in npy_load()
+    uint64_t const data_offset = header_size;
+    size_t const alignment = std::max<size_t>(
+        std::min<uint64_t>(data_offset & (~data_offset + 1), 0x200000),
+        alignof(std::max_align_t));
+    request.buffer =
+        request.allocator
+            ? request.allocator(num_bytes, alignment)
+            : std::make_unique<InMemoryBuffer>(num_bytes, alignment);
+
+    // the beginning of the data may have been read with the header already
+    size_t const prefetched = std::min<uint64_t>(
+        request.header_bytes - header_size, num_bytes);
+    std::copy_n(request.header.data() + header_size, prefetched,
+                reinterpret_cast<char*>(request.buffer->data()));
+
+    request.phase = Request::Phase::Data;
+    for (uint64_t pos = prefetched; pos < num_bytes; pos += chunk_size) {
+      enqueue({&request, request.buffer->data() + pos,
+               static_cast<size_t>(
+                   std::min<uint64_t>(chunk_size, num_bytes - pos)),
+               data_offset + pos, false, false});
+    }
+  } catch (...) {
+    request.error = std::current_exception();
+  }
+
+  if (request.pending_operations == 0) {
+    finish(request);
+  }
+}
+
+void cnpypp::UringIO::Impl::finish(Request& request) {
+  request.finished = true;
+
+  if (request.fd != -1) {
+    ::close(request.fd);
+    request.fd = -1;
+  }
+
+  if (request.is_save) {
+    if (request.error) {
+      request.save_result.set_exception(request.error);
+    } else {
+      request.save_result.set_value();
+    }
+  } else {
+    if (request.error) {
+      request.load_result.set_exception(request.error);
+    } else {
+      request.load_result.set_value(NpyArray{
+          std::move(request.shape), std::move(request.word_sizes),
+          std::move(request.labels), request.memory_order,
+          std::move(request.buffer)});
+    }
+  }
+}
+
+// fails all unfinished requests after the ring broke down. the operations
+// still in flight are never reaped, so their requests stay alive
+void cnpypp::UringIO::Impl::fail(std::exception_ptr error) {
+  ring_error = error;
+  queued_operations.clear();
+
+  for (auto& request : started) {
+    if (!request->finished) {
+      if (!request->error) {
+        request->error = error;
+      }
+      finish(*request);
+    }
+  }
+
+  if (in_flight == 0) {
+    started.clear();
+  }
+}
+
+// nullptr if io_uring is not available
+static std::unique_ptr<UringIO> make_uring() {
+  try {
+    return std::make_unique<UringIO>();
+  } catch (std::runtime_error const&) {
+    return nullptr;
+  }
+}
+
+cnpypp::NpyArray cnpypp::npy_load_uring(std::string const& fname,
+                                        BufferAllocator const& allocator) {
+  auto const uring = make_uring();
+  if (!uring) {
+    return npy_load(fname, allocator);
+  }
+
+  auto result = uring->load(fname, allocator);
+  uring->wait();
+  return result.get();
+}
+
+void cnpypp::npy_save_uring(std::string const& fname, std::vector<char> header,
+                            cnpypp::span<std::byte const> data) {
+  auto const uring = make_uring();
+  if (!uring) {
+    std::ofstream fs{fname, std::ios::binary | std::ios::trunc};
+    fs.write(header.data(), header.size());
+    fs.write(reinterpret_cast<char const*>(data.data()), data.size());
+    if (!fs) {
+      throw std::runtime_error("npy_save_uring: could not write " + fname);
+    }
+    return;
+  }
+
+  auto result = uring->save(fname, std::move(header), data);
+  uring->wait();
+  result.get();
+}